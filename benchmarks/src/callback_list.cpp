@@ -0,0 +1,71 @@
+#include "wfl/callback_list.hpp"
+#include "wfl/shared_function.hpp"
+#include "wfl/weak_function.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+// range(0) listeners of which half have expired, called through a loop
+// over a vector of weak functions, the usual way to broadcast.
+static void weak_function_vector_broadcast( benchmark::State& state )
+{
+  const std::size_t count( state.range( 0 ) );
+  std::vector< wfl::shared_function< void() > > shared;
+  std::vector< wfl::weak_function< void() > > listeners;
+
+  shared.reserve( count );
+  listeners.reserve( count );
+
+  for ( std::size_t i( 0 ); i != count; ++i )
+    {
+      shared.emplace_back
+        ( []() -> void
+          {
+            benchmark::ClobberMemory();
+          } );
+      listeners.emplace_back( shared.back() );
+    }
+
+  for ( std::size_t i( 0 ); i < count; i += 2 )
+    shared[ i ].reset();
+
+  for ( auto _ : state )
+    for ( const wfl::weak_function< void() >& listener : listeners )
+      listener();
+
+  state.SetItemsProcessed( state.iterations() * count );
+}
+
+BENCHMARK( weak_function_vector_broadcast )->Range( 64, 4096 );
+
+// The same listeners in a callback list, which drops the expired ones
+// during its first call.
+static void callback_list_broadcast( benchmark::State& state )
+{
+  const std::size_t count( state.range( 0 ) );
+  std::vector< wfl::shared_function< void() > > shared;
+  wfl::callback_list< void() > listeners;
+
+  shared.reserve( count );
+
+  for ( std::size_t i( 0 ); i != count; ++i )
+    {
+      shared.emplace_back
+        ( []() -> void
+          {
+            benchmark::ClobberMemory();
+          } );
+      listeners.add( shared.back() );
+    }
+
+  for ( std::size_t i( 0 ); i < count; i += 2 )
+    shared[ i ].reset();
+
+  for ( auto _ : state )
+    benchmark::DoNotOptimize( listeners() );
+
+  state.SetItemsProcessed( state.iterations() * count );
+}
+
+BENCHMARK( callback_list_broadcast )->Range( 64, 4096 );
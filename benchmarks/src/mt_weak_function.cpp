@@ -0,0 +1,274 @@
+#include "wfl/mt/call_dispatcher.hpp"
+#include "wfl/mt/function_group.hpp"
+#include "wfl/mt/shared_function.hpp"
+#include "wfl/mt/thread_pool.hpp"
+#include "wfl/mt/weak_function.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Each thread calls its own function. The throughput of the calls should
+// grow linearly with the number of threads.
+static void mt_weak_function_call_per_thread( benchmark::State& state )
+{
+  int call_count( 0 );
+  
+  const wfl::mt::shared_function< void() > shared
+    ( [ & ]() -> void
+      {
+        ++call_count;
+      } );
+  const wfl::mt::weak_function< void() > weak( shared );
+
+  for ( auto _ : state )
+    weak();
+
+  benchmark::DoNotOptimize( call_count );
+  state.SetItemsProcessed( state.iterations() );
+}
+
+BENCHMARK( mt_weak_function_call_per_thread )->ThreadRange( 1, 16 )
+  ->UseRealTime();
+
+// All threads call the same function.
+static std::unique_ptr< wfl::mt::shared_function< void() > >
+mt_weak_function_shared_callee;
+
+static void mt_weak_function_call_same_function( benchmark::State& state )
+{
+  if ( state.thread_index() == 0 )
+    mt_weak_function_shared_callee.reset
+      ( new wfl::mt::shared_function< void() >
+        ( []() -> void
+          {
+            benchmark::ClobberMemory();
+          } ) );
+
+  // The benchmark library synchronizes the threads before running the loop,
+  // thus the function is available to every thread.
+  for ( auto _ : state )
+    {
+      const wfl::mt::weak_function< void() > weak
+        ( *mt_weak_function_shared_callee );
+      weak();
+    }
+
+  state.SetItemsProcessed( state.iterations() );
+
+  if ( state.thread_index() == 0 )
+    mt_weak_function_shared_callee.reset();
+}
+
+BENCHMARK( mt_weak_function_call_same_function )->ThreadRange( 1, 16 )
+  ->UseRealTime();
+
+// Calls a weak function whose shared function is gone.
+static void mt_weak_function_call_expired( benchmark::State& state )
+{
+  wfl::mt::weak_function< void() > weak;
+
+  {
+    const wfl::mt::shared_function< void() > shared
+      ( []() -> void
+        {
+        } );
+    weak = shared;
+  }
+  
+  for ( auto _ : state )
+    weak();
+
+  state.SetItemsProcessed( state.iterations() );
+}
+
+BENCHMARK( mt_weak_function_call_expired )->ThreadRange( 1, 16 )
+  ->UseRealTime();
+
+// Each thread creates and destroys its own functions. With the allocator
+// split in shards the throughput should grow with the number of threads.
+static void mt_shared_function_create_destroy( benchmark::State& state )
+{
+  for ( auto _ : state )
+    {
+      const wfl::mt::shared_function< void() > shared
+        ( []() -> void
+          {
+          } );
+      benchmark::DoNotOptimize( shared );
+    }
+
+  state.SetItemsProcessed( state.iterations() );
+}
+
+BENCHMARK( mt_shared_function_create_destroy )->ThreadRange( 1, 16 )
+  ->UseRealTime();
+
+// Calls a batch of functions, half of them being expired.
+static void mt_weak_function_call_all( benchmark::State& state )
+{
+  const std::size_t count( state.range( 0 ) );
+  std::vector< wfl::mt::shared_function< void() > > shared;
+  std::vector< wfl::mt::weak_function< void() > > weak;
+
+  shared.reserve( count );
+  weak.reserve( count );
+
+  for ( std::size_t i( 0 ); i != count; ++i )
+    {
+      shared.emplace_back
+        ( []() -> void
+          {
+            benchmark::ClobberMemory();
+          } );
+      weak.emplace_back( shared.back() );
+    }
+
+  for ( std::size_t i( 0 ); i < count; i += 2 )
+    shared[ i ].reset();
+
+  for ( auto _ : state )
+    benchmark::DoNotOptimize
+      ( wfl::mt::weak_function< void() >::call_all
+        ( weak.begin(), weak.end() ) );
+
+  state.SetItemsProcessed( state.iterations() * count );
+}
+
+BENCHMARK( mt_weak_function_call_all )->Range( 64, 4096 );
+
+// Posts each of the functions range(1) times to a dispatcher before
+// dispatching them, such that the repeated posts are coalesced.
+static void mt_call_dispatcher_post_dispatch( benchmark::State& state )
+{
+  const std::size_t count( state.range( 0 ) );
+  const std::size_t repeat( state.range( 1 ) );
+  std::vector< wfl::mt::shared_function< void() > > shared;
+  std::vector< wfl::mt::weak_function< void() > > weak;
+
+  shared.reserve( count );
+  weak.reserve( count );
+
+  for ( std::size_t i( 0 ); i != count; ++i )
+    {
+      shared.emplace_back
+        ( []() -> void
+          {
+            benchmark::ClobberMemory();
+          } );
+      weak.emplace_back( shared.back() );
+    }
+
+  wfl::mt::call_dispatcher dispatcher;
+
+  for ( auto _ : state )
+    {
+      for ( std::size_t r( 0 ); r != repeat; ++r )
+        for ( const wfl::mt::weak_function< void() >& w : weak )
+          dispatcher.post( w );
+
+      benchmark::DoNotOptimize( dispatcher.dispatch() );
+    }
+
+  state.SetItemsProcessed( state.iterations() * count * repeat );
+}
+
+BENCHMARK( mt_call_dispatcher_post_dispatch )
+  ->Args( { 64, 1 } )->Args( { 64, 16 } )->Args( { 1024, 16 } );
+
+// Runs 1024 tasks in a pool of four workers, range(0) percent of them
+// having expired before they are dequeued.
+static void mt_thread_pool_run( benchmark::State& state )
+{
+  constexpr std::size_t count( 1024 );
+  const std::size_t expired_count( count * state.range( 0 ) / 100 );
+
+  std::vector< wfl::mt::shared_function< void() > > shared;
+  std::vector< wfl::mt::weak_function< void() > > weak;
+
+  shared.reserve( count );
+  weak.reserve( count );
+
+  for ( std::size_t i( 0 ); i != count; ++i )
+    {
+      shared.emplace_back
+        ( []() -> void
+          {
+            int value( 0 );
+
+            for ( int j( 0 ); j != 1000; ++j )
+              benchmark::DoNotOptimize( value += j );
+          } );
+      weak.emplace_back( shared.back() );
+    }
+
+  for ( std::size_t i( 0 ); i != expired_count; ++i )
+    shared[ i ].reset();
+
+  wfl::mt::thread_pool pool( 4 );
+  std::uint64_t done( 0 );
+
+  for ( auto _ : state )
+    {
+      for ( const wfl::mt::weak_function< void() >& w : weak )
+        pool.submit( w );
+
+      done += count;
+
+      while ( pool.run_count() + pool.dropped_count() != done )
+        std::this_thread::yield();
+    }
+
+  state.SetItemsProcessed( state.iterations() * count );
+}
+
+BENCHMARK( mt_thread_pool_run )->Arg( 0 )->Arg( 50 )->Arg( 100 )
+  ->UseRealTime();
+
+// Creates then releases a batch of functions owned by an object, either
+// one shared_function per function or a single group.
+static void mt_shared_function_teardown( benchmark::State& state )
+{
+  const std::size_t count( state.range( 0 ) );
+  std::vector< wfl::mt::shared_function< void() > > functions;
+  functions.reserve( count );
+
+  for ( auto _ : state )
+    {
+      for ( std::size_t i( 0 ); i != count; ++i )
+        functions.emplace_back
+          ( []() -> void
+            {
+            } );
+
+      functions.clear();
+    }
+
+  state.SetItemsProcessed( state.iterations() * count );
+}
+
+BENCHMARK( mt_shared_function_teardown )->Arg( 16 )->Arg( 64 );
+
+static void mt_function_group_teardown( benchmark::State& state )
+{
+  const std::size_t count( state.range( 0 ) );
+  wfl::mt::function_group group;
+
+  for ( auto _ : state )
+    {
+      for ( std::size_t i( 0 ); i != count; ++i )
+        benchmark::DoNotOptimize
+          ( group.add< void() >
+            ( []() -> void
+              {
+              } ) );
+
+      group.expire();
+    }
+
+  state.SetItemsProcessed( state.iterations() * count );
+}
+
+BENCHMARK( mt_function_group_teardown )->Arg( 16 )->Arg( 64 );
@@ -0,0 +1,195 @@
+#include "wfl/mt/shared_function.hpp"
+#include "wfl/mt/weak_function.hpp"
+#include "wfl/shared_function.hpp"
+#include "wfl/weak_function.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <functional>
+#include <memory>
+
+namespace wfl
+{
+  namespace benchmarks
+  {
+    // A callable of Size bytes. The small one fits in the buffer of
+    // std::function, the medium one does not but fits in the blocks of the
+    // allocators, and the large one is allocated on the heap by all
+    // implementations.
+    template< std::size_t Size >
+    struct callable
+    {
+      void operator()() const
+      {
+        benchmark::DoNotOptimize( payload[ 0 ] );
+      }
+
+      char payload[ Size ] = {};
+    };
+
+    typedef callable< sizeof( void* ) > small_callable;
+    typedef callable< 64 > medium_callable;
+    typedef callable< 512 > large_callable;
+
+    struct thread_local_functions
+    {
+      typedef wfl::shared_function< void() > shared;
+      typedef wfl::weak_function< void() > weak;
+
+      template< typename F >
+      static shared make( const F& f )
+      {
+        return shared( f );
+      }
+
+      static weak observe( const shared& s )
+      {
+        return weak( s );
+      }
+
+      static void call( const weak& w )
+      {
+        w();
+      }
+    };
+
+    struct thread_safe_functions
+    {
+      typedef wfl::mt::shared_function< void() > shared;
+      typedef wfl::mt::weak_function< void() > weak;
+
+      template< typename F >
+      static shared make( const F& f )
+      {
+        return shared( f );
+      }
+
+      static weak observe( const shared& s )
+      {
+        return weak( s );
+      }
+
+      static void call( const weak& w )
+      {
+        w();
+      }
+    };
+
+    // The usual alternative to wfl, for comparison.
+    struct std_functions
+    {
+      typedef std::shared_ptr< std::function< void() > > shared;
+      typedef std::weak_ptr< std::function< void() > > weak;
+
+      template< typename F >
+      static shared make( const F& f )
+      {
+        return std::make_shared< std::function< void() > >( f );
+      }
+
+      static weak observe( const shared& s )
+      {
+        return weak( s );
+      }
+
+      static void call( const weak& w )
+      {
+        const shared s( w.lock() );
+
+        if ( s )
+          ( *s )();
+      }
+    };
+  }
+}
+
+template< typename Functions, typename Callable >
+static void create_destroy( benchmark::State& state )
+{
+  const Callable callable{};
+
+  for ( auto _ : state )
+    {
+      const typename Functions::shared shared( Functions::make( callable ) );
+      benchmark::DoNotOptimize( shared );
+    }
+
+  state.SetItemsProcessed( state.iterations() );
+}
+
+template< typename Functions, typename Callable >
+static void copy_shared( benchmark::State& state )
+{
+  const typename Functions::shared shared( Functions::make( Callable() ) );
+
+  for ( auto _ : state )
+    {
+      const typename Functions::shared copy( shared );
+      benchmark::DoNotOptimize( copy );
+    }
+
+  state.SetItemsProcessed( state.iterations() );
+}
+
+template< typename Functions, typename Callable >
+static void call_weak( benchmark::State& state )
+{
+  const typename Functions::shared shared( Functions::make( Callable() ) );
+  const typename Functions::weak weak( Functions::observe( shared ) );
+
+  for ( auto _ : state )
+    Functions::call( weak );
+
+  state.SetItemsProcessed( state.iterations() );
+}
+
+template< typename Functions, typename Callable >
+static void call_expired( benchmark::State& state )
+{
+  typename Functions::weak weak;
+
+  {
+    const typename Functions::shared shared
+      ( Functions::make( Callable() ) );
+    weak = Functions::observe( shared );
+  }
+
+  for ( auto _ : state )
+    Functions::call( weak );
+
+  state.SetItemsProcessed( state.iterations() );
+}
+
+#define wfl_benchmark_all( name )                                       \
+  BENCHMARK_TEMPLATE                                                    \
+  ( name, wfl::benchmarks::thread_local_functions,                      \
+    wfl::benchmarks::small_callable );                                  \
+  BENCHMARK_TEMPLATE                                                    \
+  ( name, wfl::benchmarks::thread_local_functions,                      \
+    wfl::benchmarks::medium_callable );                                 \
+  BENCHMARK_TEMPLATE                                                    \
+  ( name, wfl::benchmarks::thread_local_functions,                      \
+    wfl::benchmarks::large_callable );                                  \
+  BENCHMARK_TEMPLATE                                                    \
+  ( name, wfl::benchmarks::thread_safe_functions,                       \
+    wfl::benchmarks::small_callable );                                  \
+  BENCHMARK_TEMPLATE                                                    \
+  ( name, wfl::benchmarks::thread_safe_functions,                       \
+    wfl::benchmarks::medium_callable );                                 \
+  BENCHMARK_TEMPLATE                                                    \
+  ( name, wfl::benchmarks::thread_safe_functions,                       \
+    wfl::benchmarks::large_callable );                                  \
+  BENCHMARK_TEMPLATE                                                    \
+  ( name, wfl::benchmarks::std_functions,                               \
+    wfl::benchmarks::small_callable );                                  \
+  BENCHMARK_TEMPLATE                                                    \
+  ( name, wfl::benchmarks::std_functions,                               \
+    wfl::benchmarks::medium_callable );                                 \
+  BENCHMARK_TEMPLATE                                                    \
+  ( name, wfl::benchmarks::std_functions,                               \
+    wfl::benchmarks::large_callable )
+
+wfl_benchmark_all( create_destroy );
+wfl_benchmark_all( copy_shared );
+wfl_benchmark_all( call_weak );
+wfl_benchmark_all( call_expired );
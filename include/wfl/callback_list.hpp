@@ -0,0 +1,19 @@
+#pragma once
+
+#include "wfl/detail/callback_list.hpp"
+#include "wfl/detail/function_allocator.hpp"
+
+namespace wfl
+{
+  template< typename F >
+  using callback_list =
+    detail::callback_list< F, detail::thread_local_function_allocator >;
+}
+
+#ifndef WFL_HEADER_ONLY
+extern template class wfl::detail::callback_list
+<
+  void(),
+  wfl::detail::thread_local_function_allocator
+>;
+#endif
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+namespace wfl
+{
+  namespace detail
+  {
+    // Allocates size bytes aligned on alignment, a power of two. Before
+    // C++17, operator new does not honor the alignments larger than the one
+    // of std::max_align_t, thus the memory is over-allocated and the
+    // address returned by operator new is stored before the aligned block.
+    inline void* aligned_allocate( std::size_t size, std::size_t alignment )
+    {
+      if ( alignment <= alignof( std::max_align_t ) )
+        return ::operator new( size );
+
+      void* const memory
+        ( ::operator new( size + alignment - 1 + sizeof( void* ) ) );
+      const std::uintptr_t first
+        ( reinterpret_cast< std::uintptr_t >( memory ) + sizeof( void* ) );
+      void** const result
+        ( reinterpret_cast< void** >
+          ( ( first + alignment - 1 ) & ~std::uintptr_t( alignment - 1 ) ) );
+
+      result[ -1 ] = memory;
+      return result;
+    }
+
+    inline void aligned_deallocate( void* p, std::size_t alignment )
+    {
+      if ( alignment <= alignof( std::max_align_t ) )
+        ::operator delete( p );
+      else if ( p != nullptr )
+        ::operator delete( static_cast< void** >( p )[ -1 ] );
+    }
+
+    template< typename T, typename... Args >
+    T* aligned_new( Args&&... args )
+    {
+      void* const memory( aligned_allocate( sizeof( T ), alignof( T ) ) );
+
+      try
+        {
+          return new ( memory ) T( std::forward< Args >( args )... );
+        }
+      catch( ... )
+        {
+          aligned_deallocate( memory, alignof( T ) );
+          throw;
+        }
+    }
+
+    template< typename T >
+    void aligned_delete( T* p )
+    {
+      if ( p == nullptr )
+        return;
+
+      p->~T();
+      aligned_deallocate( p, alignof( T ) );
+    }
+
+    // Deletes with aligned_delete, for the objects allocated with
+    // aligned_new and owned by a std::unique_ptr.
+    struct aligned_deleter
+    {
+      template< typename T >
+      void operator()( T* p ) const
+      {
+        aligned_delete( p );
+      }
+    };
+  }
+}
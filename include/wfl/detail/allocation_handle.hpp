@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace wfl
+{
+  namespace detail
+  {
+    // The reference to a block, packed in a single 64 bits word such that
+    // it can be copied in a register and loaded atomically. The low bits of
+    // the id are used by the allocators to encode the size class and the
+    // shard of the block, the remaining bits are the index of the block in
+    // its storage.
+    struct alignas( std::uint64_t ) allocation_handle
+    {
+      static constexpr std::uint32_t not_a_version = 0;
+
+      // The version after which a block is never reused, such that a
+      // version cannot wrap and match an old handle.
+      static constexpr std::uint32_t last_version = 0xffffffff;
+
+      // The number of bits available for the index of a block in its
+      // storage.
+      static constexpr std::size_t storage_id_bits = 25;
+      static constexpr std::size_t max_storage_block_count =
+        std::size_t( 1 ) << storage_id_bits;
+
+      std::uint32_t version = not_a_version;
+      std::uint32_t id = 0;
+    };
+
+    static_assert
+      ( sizeof( allocation_handle ) == sizeof( std::uint64_t ),
+        "The handle must fit in a 64 bits word." );
+
+    // Orders the handles by the position of their blocks: first by
+    // storage, as given by the storage_bits low bits of the id, then by
+    // index in the storage.
+    struct block_order
+    {
+      explicit block_order( std::size_t storage_bits )
+        : m_storage_bits( storage_bits )
+      {
+
+      }
+
+      bool operator()
+      ( const allocation_handle& a, const allocation_handle& b ) const
+      {
+        return key( a ) < key( b );
+      }
+
+    private:
+      std::uint64_t key( const allocation_handle& handle ) const
+      {
+        const std::uint64_t storage
+          ( handle.id & ( ( std::uint32_t( 1 ) << m_storage_bits ) - 1 ) );
+
+        return ( storage << 32 ) | ( handle.id >> m_storage_bits );
+      }
+
+    private:
+      std::size_t m_storage_bits;
+    };
+  }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "wfl/detail/config.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace wfl
+{
+  namespace detail
+  {
+    // A snapshot of the counters of an allocator. The counters are kept by
+    // each storage and aggregated when the snapshot is taken, thus the peak
+    // is the sum of the peaks of the storages, an upper bound of the actual
+    // peak.
+    struct allocator_statistics
+    {
+      // The blocks whose function has not been destroyed yet.
+      std::size_t live_count = 0;
+      std::size_t peak_live_count = 0;
+
+      std::uint64_t allocation_count = 0;
+      std::uint64_t release_count = 0;
+
+      // The safe calls of an alive function and of an expired one.
+      std::uint64_t call_count = 0;
+      std::uint64_t expired_call_count = 0;
+
+      // The length of the free lists.
+      std::size_t available_count = 0;
+
+      // The pages of blocks currently allocated, used or not.
+      std::size_t page_count = 0;
+
+      // The number of times a thread had to wait for the lock of a
+      // thread-safe storage, and the total time spent waiting.
+      std::uint64_t contention_count = 0;
+      std::chrono::nanoseconds lock_wait_time{ 0 };
+
+      allocator_statistics& operator+=( const allocator_statistics& that );
+    };
+  }
+}
+
+#ifdef WFL_HEADER_ONLY
+  #include "wfl/detail/impl/allocator_statistics.ipp"
+#endif
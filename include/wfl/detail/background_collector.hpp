@@ -0,0 +1,46 @@
+#pragma once
+
+#include "wfl/detail/config.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace wfl
+{
+  namespace detail
+  {
+    // Enables the deferred destruction in the thread-safe allocator and
+    // collects the released functions periodically in a dedicated thread,
+    // for the lifetime of this object. The destruction of the functions
+    // then never happens in the threads allocating or calling them.
+    class background_collector
+    {
+    public:
+      explicit background_collector( std::chrono::milliseconds period );
+
+      // Stops the thread and disables the deferred destruction, which
+      // collects the pending functions.
+      ~background_collector();
+
+      background_collector( const background_collector& ) = delete;
+      background_collector&
+      operator=( const background_collector& ) = delete;
+
+    private:
+      void run();
+
+    private:
+      const std::chrono::milliseconds m_period;
+      std::mutex m_mutex;
+      std::condition_variable m_condition;
+      bool m_stop;
+      std::thread m_thread;
+    };
+  }
+}
+
+#ifdef WFL_HEADER_ONLY
+  #include "wfl/detail/impl/background_collector.ipp"
+#endif
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "wfl/detail/allocation_handle.hpp"
+#include "wfl/detail/config.hpp"
+#include "wfl/detail/mpsc_queue.hpp"
+#include "wfl/detail/thread_safe_function_allocator.hpp"
+#include "wfl/detail/weak_function.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace wfl
+{
+  namespace detail
+  {
+    // Defers the calls of thread-safe weak functions to a consumer thread.
+    // Any thread can post a function without waiting, and the calls posted
+    // several times for the same function before a dispatch are done only
+    // once. The expired functions are dropped by the dispatch without being
+    // called.
+    class call_dispatcher
+    {
+    public:
+      typedef
+      weak_function< void(), thread_safe_function_allocator > function_type;
+
+    public:
+      call_dispatcher();
+
+      // The calls not yet dispatched are dropped.
+      ~call_dispatcher();
+
+      call_dispatcher( const call_dispatcher& ) = delete;
+      call_dispatcher& operator=( const call_dispatcher& ) = delete;
+
+      // Schedules a call of f for the next dispatch. Can be called from any
+      // thread, including from a function being dispatched.
+      void post( const function_type& f );
+
+      // Calls the functions posted since the last dispatch, in the order of
+      // their storage, and returns the number of functions called. Only
+      // one thread at a time can dispatch.
+      std::size_t dispatch();
+
+    private:
+      // The handles whose probe in the slots found no room, waiting in
+      // the overflow queue.
+      struct posted_call : mpsc_node
+      {
+        allocation_handle handle;
+      };
+
+      static constexpr std::size_t slot_count_log2 = 10;
+      static constexpr std::size_t slot_count =
+        std::size_t( 1 ) << slot_count_log2;
+      static constexpr std::size_t max_probe_count = 16;
+
+    private:
+      // The key of a handle is never zero since its version is not
+      // not_a_version.
+      static std::uint64_t key( const allocation_handle& handle );
+      static allocation_handle handle_of( std::uint64_t key );
+      static std::size_t first_slot( std::uint64_t key );
+
+      // Marks the handle of the key as posted. Returns false if there is
+      // no room for it in the probed slots.
+      bool post_in_slot( std::uint64_t key );
+
+    private:
+      // The keys of the posted handles, zero for a free slot. A handle
+      // posted again before the dispatch finds its key in the slots and
+      // stops there, thus a repeated post neither allocates nor queues
+      // anything.
+      std::atomic< std::uint64_t > m_slots[ slot_count ];
+
+      // The number of keys in the slots. It may be transiently off while a
+      // post and a dispatch run concurrently, such that the dispatch skips
+      // the scan of the slots only when nothing was posted.
+      std::atomic< std::size_t > m_posted_count;
+
+      mpsc_queue m_overflow;
+
+      // The handles of the dispatch in progress, kept such that their
+      // memory is reused from one dispatch to the next.
+      std::vector< allocation_handle > m_handles;
+    };
+  }
+}
+
+#ifdef WFL_HEADER_ONLY
+  #include "wfl/detail/impl/call_dispatcher.ipp"
+#endif
@@ -0,0 +1,266 @@
+#pragma once
+
+#include "wfl/memory_resource.hpp"
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace wfl
+{
+  namespace detail
+  {
+    template< typename Signature, typename F, std::size_t Size, bool Inline >
+    struct callable_model;
+
+    // Converts an argument to the type expected by callable_storage::invoke
+    // for a parameter of type T. Only lvalues passed to a parameter taken
+    // by value are copied, the other arguments are passed by reference.
+    template< typename T >
+    struct argument
+    {
+      static T&& pass( T&& a )
+      {
+        return std::move( a );
+      }
+
+      static T pass( const T& a )
+      {
+        return a;
+      }
+    };
+
+    template< typename T >
+    struct argument< T& >
+    {
+      static T& pass( T& a )
+      {
+        return a;
+      }
+    };
+
+    template< typename T >
+    struct argument< T&& >
+    {
+      static T&& pass( T&& a )
+      {
+        return std::move( a );
+      }
+    };
+
+    // Converts an argument passed to several calls to the type expected by
+    // callable_storage::invoke for a parameter of type T. The arguments
+    // taken by value or by rvalue reference are copied for each call, such
+    // that no call receives an argument moved by a previous one.
+    template< typename T >
+    struct repeated_argument
+    {
+      static T pass( const T& a )
+      {
+        return a;
+      }
+    };
+
+    template< typename T >
+    struct repeated_argument< T& >
+    {
+      static T& pass( T& a )
+      {
+        return a;
+      }
+    };
+
+    template< typename T >
+    struct repeated_argument< T&& >
+    {
+      static_assert
+        ( std::is_copy_constructible< T >::value,
+          "The functions called in batch cannot take a move-only argument"
+          " by rvalue reference." );
+
+      static T pass( const T& a )
+      {
+        return a;
+      }
+    };
+
+    // Type-erased access to a callable. The storage keeps the functions to
+    // call and to destroy the callable, thus a call goes through a single
+    // indirection. The callable itself is stored in the buffer of a
+    // sized_callable_storage.
+    class alignas( std::max_align_t ) callable_storage
+    {
+      template< typename Signature, typename F, std::size_t Size, bool Inline >
+      friend struct callable_model;
+
+    public:
+      void destroy()
+      {
+        m_destroy( *this );
+      }
+
+      // Calls the callable, which must have been constructed with the
+      // signature R( Args... ). Like std::function, the callable is invoked
+      // as a non-const object.
+      template< typename R, typename... Args >
+      R invoke( Args&&... args ) const
+      {
+        typedef R ( *invoke_function )( callable_storage&, Args&&... );
+
+        return reinterpret_cast< invoke_function >( m_invoke )
+          ( const_cast< callable_storage& >( *this ),
+            std::forward< Args >( args )... );
+      }
+
+    private:
+      typedef void ( *erased_function )();
+      typedef void ( *destroy_function )( callable_storage& );
+
+    private:
+      erased_function m_invoke;
+      destroy_function m_destroy;
+    };
+
+    // A callable_storage with an inline buffer of Size bytes. The callable
+    // is stored in place if it fits in the buffer, otherwise it is
+    // allocated from the given memory resource.
+    template< std::size_t Size >
+    class sized_callable_storage:
+      public callable_storage
+    {
+      template< typename Signature, typename F, std::size_t S, bool Inline >
+      friend struct callable_model;
+
+    public:
+      static constexpr std::size_t inline_size = Size;
+
+      typedef
+      typename std::aligned_storage
+      <
+        Size,
+        alignof( std::max_align_t )
+      >::type
+      buffer_type;
+
+      template< typename F >
+      struct fits_inline
+        : std::integral_constant
+          <
+            bool,
+            ( sizeof( F ) <= sizeof( buffer_type ) )
+            && ( alignof( buffer_type ) % alignof( F ) == 0 )
+          >
+      {};
+
+    public:
+      template< typename Signature, typename F >
+      void construct( F&& f, memory_resource& resource )
+      {
+        typedef typename std::decay< F >::type callable_type;
+
+        callable_model
+          <
+            Signature,
+            callable_type,
+            Size,
+            fits_inline< callable_type >::value
+          >::construct( *this, std::forward< F >( f ), resource );
+      }
+
+    private:
+      buffer_type m_buffer;
+    };
+
+    template< typename F, std::size_t Size, typename R, typename... Args >
+    struct callable_model< R( Args... ), F, Size, true >
+    {
+      typedef sized_callable_storage< Size > storage_type;
+
+      template< typename T >
+      static void construct( storage_type& storage, T&& f, memory_resource& )
+      {
+        new ( &storage.m_buffer ) F( std::forward< T >( f ) );
+        storage.m_invoke =
+          reinterpret_cast< callable_storage::erased_function >( &invoke );
+        storage.m_destroy = &destroy;
+      }
+
+      static R invoke( callable_storage& storage, Args&&... args )
+      {
+        return ( *get( storage ) )( std::forward< Args >( args )... );
+      }
+
+      static void destroy( callable_storage& storage )
+      {
+        get( storage )->~F();
+      }
+
+      static F* get( callable_storage& storage )
+      {
+        return reinterpret_cast< F* >
+          ( &static_cast< storage_type& >( storage ).m_buffer );
+      }
+    };
+
+    template< typename F, std::size_t Size, typename R, typename... Args >
+    struct callable_model< R( Args... ), F, Size, false >
+    {
+      typedef sized_callable_storage< Size > storage_type;
+
+      // The resource is kept with the callable to release its memory.
+      struct allocation
+      {
+        F* callable;
+        memory_resource* resource;
+      };
+
+      static_assert
+        ( storage_type::template fits_inline< allocation >::value,
+          "The storage cannot hold a pointer to the function." );
+
+      template< typename T >
+      static void construct
+      ( storage_type& storage, T&& f, memory_resource& resource )
+      {
+        void* const memory( resource.allocate( sizeof( F ), alignof( F ) ) );
+
+        try
+          {
+            new ( memory ) F( std::forward< T >( f ) );
+          }
+        catch( ... )
+          {
+            resource.deallocate( memory, sizeof( F ), alignof( F ) );
+            throw;
+          }
+
+        new ( &storage.m_buffer )
+          allocation{ static_cast< F* >( memory ), &resource };
+        storage.m_invoke =
+          reinterpret_cast< callable_storage::erased_function >( &invoke );
+        storage.m_destroy = &destroy;
+      }
+
+      static R invoke( callable_storage& storage, Args&&... args )
+      {
+        return ( *get( storage ).callable )
+          ( std::forward< Args >( args )... );
+      }
+
+      static void destroy( callable_storage& storage )
+      {
+        const allocation a( get( storage ) );
+
+        a.callable->~F();
+        a.resource->deallocate( a.callable, sizeof( F ), alignof( F ) );
+      }
+
+      static allocation& get( callable_storage& storage )
+      {
+        return *reinterpret_cast< allocation* >
+          ( &static_cast< storage_type& >( storage ).m_buffer );
+      }
+    };
+  }
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "wfl/detail/weak_function.hpp"
+
+#include <stdexcept>
+#include <vector>
+
+namespace wfl
+{
+  namespace detail
+  {
+    template< typename F, typename FunctionAllocator >
+    class callback_list;
+
+    // A list of weak functions called all at once with the same arguments.
+    // The handles are stored contiguously and the functions are called in
+    // the order of their storage, in a single pass which also removes the
+    // expired functions from the list.
+    //
+    // Functions can be added to the list, and the list can be cleared,
+    // from a function being called by the list. Clearing the list stops
+    // the call before the next function. The list cannot be called
+    // recursively: a call from a function being called by the list throws
+    // std::logic_error.
+    //
+    // The list itself is not thread-safe, even with thread-safe functions:
+    // the calls, the additions and the clearing of a list must not run
+    // concurrently.
+    template< typename FunctionAllocator, typename R, typename... Args >
+    class callback_list< R( Args... ), FunctionAllocator >
+    {
+    public:
+      typedef weak_function< R( Args... ), FunctionAllocator > weak_type;
+
+    private:
+      typedef FunctionAllocator function_allocator;
+      typedef typename function_allocator::allocation_handle
+      allocation_handle;
+
+    public:
+      callback_list()
+        : m_generation( 0 ),
+          m_calling( false )
+      {
+
+      }
+
+      void add( const weak_type& f )
+      {
+        if ( m_calling )
+          m_added.emplace_back( f.m_handle );
+        else
+          m_handles.emplace_back( f.m_handle );
+      }
+
+      void clear()
+      {
+        ++m_generation;
+
+        if ( m_calling )
+          m_added.clear();
+        else
+          m_handles.clear();
+      }
+
+      // The number of functions in the list. The expired functions are
+      // counted until the next call of the list.
+      std::size_t size() const
+      {
+        return m_handles.size() + m_added.size();
+      }
+
+      bool empty() const
+      {
+        return size() == 0;
+      }
+
+      // Calls the functions with the given arguments and returns the
+      // number of functions that were alive. The results of the functions
+      // are ignored.
+      std::size_t operator()( Args... args )
+      {
+        if ( m_calling )
+          throw std::logic_error
+            ( "wfl: a callback_list was called from one of its functions." );
+
+        const call_scope scope( *this );
+
+        return function_allocator::instance().template safe_call_all_until
+          < R, Args... >( m_handles, scope, args... );
+      }
+
+    private:
+      // Applies the changes requested during a call once it is over. The
+      // call stops when the list is cleared, which changes its generation.
+      class call_scope
+      {
+      public:
+        explicit call_scope( callback_list& list )
+          : m_list( list ),
+            m_generation( list.m_generation )
+        {
+          m_list.m_calling = true;
+        }
+
+        ~call_scope()
+        {
+          m_list.m_calling = false;
+
+          if ( cleared() )
+            m_list.m_handles.clear();
+
+          m_list.m_handles.insert
+            ( m_list.m_handles.end(), m_list.m_added.begin(),
+              m_list.m_added.end() );
+          m_list.m_added.clear();
+        }
+
+        bool operator()() const
+        {
+          return cleared();
+        }
+
+      private:
+        bool cleared() const
+        {
+          return m_list.m_generation != m_generation;
+        }
+
+      private:
+        callback_list& m_list;
+        const std::size_t m_generation;
+      };
+
+    private:
+      std::vector< allocation_handle > m_handles;
+
+      // The functions added during a call.
+      std::vector< allocation_handle > m_added;
+
+      // Incremented by each clear().
+      std::size_t m_generation;
+      bool m_calling;
+    };
+  }
+}
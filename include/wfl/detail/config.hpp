@@ -0,0 +1,16 @@
+#pragma once
+
+// In header-only mode the definitions of the library are included by its
+// headers, thus they must be inline. Otherwise they are compiled in the
+// library.
+#ifdef WFL_HEADER_ONLY
+  #define wfl_inline inline
+#else
+  #define wfl_inline
+#endif
+
+// The size of the largest buffer in which the callables are stored without
+// any dynamic allocation. Larger callables are allocated on the heap.
+#ifndef WFL_INLINE_CALLABLE_SIZE
+  #define WFL_INLINE_CALLABLE_SIZE 256
+#endif
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "wfl/detail/config.hpp"
+
+#include <cstdint>
+
+namespace wfl
+{
+  namespace detail
+  {
+    // Epoch-based reclamation shared by all the thread-safe storages. A
+    // reader announces the epoch in which it accesses the blocks, then an
+    // object retired in an epoch can be reclaimed once every reader has
+    // moved past this epoch.
+    class epoch_domain
+    {
+    public:
+      typedef std::uint64_t epoch_type;
+
+    public:
+      // Enters a critical section for the calling thread. The sections can
+      // be nested. No object retired during a section is reclaimed before
+      // its end, thus the sections should be kept short.
+      static void enter();
+
+      // Leaves the critical section of the calling thread. Returns true if
+      // this was the outermost section.
+      static bool leave();
+
+      // The epoch to associate with an object retired now.
+      static epoch_type current();
+
+      // Starts a new epoch and returns the oldest epoch in which a reader
+      // may still be. The objects retired before this epoch are not
+      // reachable anymore.
+      static epoch_type synchronize();
+    };
+
+    // Keeps the calling thread in a critical section for the lifetime of
+    // this object.
+    class epoch_section
+    {
+    public:
+      epoch_section()
+      {
+        epoch_domain::enter();
+      }
+
+      epoch_section( const epoch_section& ) = delete;
+      epoch_section& operator=( const epoch_section& ) = delete;
+
+      ~epoch_section()
+      {
+        epoch_domain::leave();
+      }
+    };
+  }
+}
+
+#ifdef WFL_HEADER_ONLY
+  #include "wfl/detail/impl/epoch_domain.ipp"
+#endif
@@ -0,0 +1,355 @@
+#pragma once
+
+#include "wfl/detail/allocation_handle.hpp"
+#include "wfl/detail/callable_storage.hpp"
+#include "wfl/detail/debug.hpp"
+#include "wfl/detail/handle_sweep.hpp"
+#include "wfl/detail/scoped_pin.hpp"
+#include "wfl/optional.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace wfl
+{
+  namespace detail
+  {
+    // An allocator used by a single thread, whose blocks are allocated
+    // once with the allocator. An allocation never grows the storage nor
+    // allocates memory: it fails when the Capacity blocks are in use, and
+    // the callables must fit in Size bytes.
+    template< std::size_t Capacity, std::size_t Size >
+    class fixed_function_allocator
+    {
+      template< typename Storage >
+      friend class scoped_pin;
+
+    public:
+      typedef detail::allocation_handle allocation_handle;
+      typedef callable_storage function_storage;
+
+      static_assert
+        ( Capacity <= allocation_handle::max_storage_block_count,
+          "The block ids do not fit in the handles." );
+
+    public:
+      fixed_function_allocator()
+        : m_available_count( Capacity ),
+          m_live_count( 0 ),
+          m_detached( false )
+      {
+        // The lowest ids are allocated first.
+        for ( std::size_t i( 0 ); i != Capacity; ++i )
+          m_available[ i ] = Capacity - i - 1;
+      }
+
+      fixed_function_allocator( const fixed_function_allocator& ) = delete;
+      fixed_function_allocator&
+      operator=( const fixed_function_allocator& ) = delete;
+
+      // Returns an empty handle if all the blocks are in use.
+      template< typename Signature, typename F >
+      allocation_handle try_allocate( F&& f )
+      {
+        typedef typename std::decay< F >::type callable_type;
+
+        static_assert
+          ( sized_callable_storage< Size >::template fits_inline
+            < callable_type >::value,
+            "The callable does not fit in the blocks." );
+
+        if ( m_available_count == 0 )
+          return allocation_handle();
+
+        const std::uint32_t id( m_available[ m_available_count - 1 ] );
+
+        // The resource is not used since the callable is stored inline.
+        m_blocks[ id ].storage.template construct< Signature >
+          ( std::forward< F >( f ), *new_delete_resource() );
+
+        --m_available_count;
+        ++m_live_count;
+
+        block_state& state( m_states[ id ] );
+        ++state.version;
+        state.ref_count = 1;
+
+        allocation_handle result;
+        result.version = state.version;
+        result.id = id;
+
+        return result;
+      }
+
+      template< typename Signature, typename F >
+      allocation_handle allocate( F&& f )
+      {
+        const allocation_handle result
+          ( try_allocate< Signature >( std::forward< F >( f ) ) );
+
+        if ( result.version == allocation_handle::not_a_version )
+          throw std::bad_alloc();
+
+        return result;
+      }
+
+      template< typename R, typename... Args, typename... A >
+      R call( const allocation_handle& handle, A&&... args )
+      {
+        const scoped_pin< fixed_function_allocator > function
+          ( *this, handle );
+
+        wfl_debug_assert( function.get() != nullptr );
+
+        return function.get()->template invoke< R, Args... >
+          ( argument< Args >::pass( std::forward< A >( args ) )... );
+      }
+
+      template< typename R, typename... Args, typename... A >
+      typename std::enable_if< std::is_void< R >::value >::type
+      safe_call( const allocation_handle& handle, A&&... args )
+      {
+        const scoped_pin< fixed_function_allocator > function
+          ( *this, handle );
+
+        if ( function.get() == nullptr )
+          return;
+
+        function.get()->template invoke< R, Args... >
+          ( argument< Args >::pass( std::forward< A >( args ) )... );
+      }
+
+      template< typename R, typename... Args, typename... A >
+      typename std::enable_if< !std::is_void< R >::value, optional< R > >::type
+      safe_call( const allocation_handle& handle, A&&... args )
+      {
+        const scoped_pin< fixed_function_allocator > function
+          ( *this, handle );
+
+        if ( function.get() == nullptr )
+          return optional< R >();
+
+        return optional< R >
+          ( in_place_invoke,
+            [ & ]() -> R
+            {
+              return function.get()->template invoke< R, Args... >
+                ( argument< Args >::pass( std::forward< A >( args ) )... );
+            } );
+      }
+
+      template< typename R, typename... Args >
+      std::size_t safe_call_all
+      ( std::vector< allocation_handle >& handles,
+        typename std::add_lvalue_reference< Args >::type... args )
+      {
+        return safe_call_all_until< R, Args... >
+          ( handles, never_stop(), args... );
+      }
+
+      template< typename R, typename... Args, typename Stop >
+      std::size_t safe_call_all_until
+      ( std::vector< allocation_handle >& handles, const Stop& stop,
+        typename std::add_lvalue_reference< Args >::type... args )
+      {
+        const block_order order( 0 );
+
+        if ( !std::is_sorted( handles.begin(), handles.end(), order ) )
+          std::sort( handles.begin(), handles.end(), order );
+
+        std::size_t result( 0 );
+        handle_sweep sweep( handles );
+
+        while ( !sweep.done() && !stop() )
+          {
+            const allocation_handle handle( sweep.next() );
+            const scoped_pin< fixed_function_allocator > function
+              ( *this, handle );
+
+            if ( function.get() == nullptr )
+              continue;
+
+            sweep.keep( handle );
+            ++result;
+            function.get()->template invoke< R, Args... >
+              ( repeated_argument< Args >::pass( args )... );
+          }
+
+        return result;
+      }
+
+      bool is_alive( const allocation_handle& handle ) const
+      {
+        if ( handle.version == allocation_handle::not_a_version )
+          return false;
+
+        const block_state& state( m_states[ handle.id ] );
+
+        return ( handle.version == state.version )
+          && ( state.ref_count != 0 );
+      }
+
+      void release_one( const allocation_handle& handle )
+      {
+        if ( handle.version == allocation_handle::not_a_version )
+          return;
+
+        block_state& state( m_states[ handle.id ] );
+
+        wfl_debug_assert( state.ref_count != 0 );
+        --state.ref_count;
+
+        if ( ( state.ref_count == 0 )
+             && ( m_blocks[ handle.id ].pin_count == 0 ) )
+          recycle( handle.id );
+      }
+
+      void add_one( const allocation_handle& handle )
+      {
+        if ( handle.version != allocation_handle::not_a_version )
+          ++m_states[ handle.id ].ref_count;
+      }
+
+      // The number of blocks that can still be allocated.
+      std::size_t available_count() const
+      {
+        return m_available_count;
+      }
+
+      // Called when the owning thread exits. The allocator is deleted if
+      // there is no function left in it, otherwise by the release of its
+      // last function, such as one stored in a thread-local object
+      // destroyed after the allocator's owner.
+      void detach()
+      {
+        m_detached = true;
+
+        if ( m_live_count == 0 )
+          delete this;
+      }
+
+    private:
+      struct block_state
+      {
+        std::uint32_t version = allocation_handle::not_a_version;
+        std::uint32_t ref_count = 0;
+      };
+
+      struct block
+      {
+        sized_callable_storage< Size > storage;
+        std::uint32_t pin_count = 0;
+      };
+
+    private:
+      const function_storage* pin( const allocation_handle& handle )
+      {
+        if ( !is_alive( handle ) )
+          return nullptr;
+
+        block& block( m_blocks[ handle.id ] );
+        ++block.pin_count;
+
+        return &block.storage;
+      }
+
+      void unpin( const allocation_handle& handle )
+      {
+        block& block( m_blocks[ handle.id ] );
+
+        wfl_debug_assert( block.pin_count != 0 );
+        --block.pin_count;
+
+        if ( ( block.pin_count == 0 )
+             && ( m_states[ handle.id ].ref_count == 0 ) )
+          recycle( handle.id );
+      }
+
+      // The block is made available after the destruction of the function
+      // since its destructor may allocate new functions. A block whose
+      // version reached the last value is never used again.
+      //
+      // The live count is decremented after the destruction too, such that
+      // a detached allocator is not deleted by the release of a function
+      // held by the callable, but by the outermost release.
+      void recycle( std::uint32_t id )
+      {
+        m_blocks[ id ].storage.destroy();
+
+        if ( m_states[ id ].version != allocation_handle::last_version )
+          {
+            m_available[ m_available_count ] = id;
+            ++m_available_count;
+          }
+
+        --m_live_count;
+
+        if ( m_detached && ( m_live_count == 0 ) )
+          delete this;
+      }
+
+    private:
+      std::array< block_state, Capacity > m_states;
+      std::array< block, Capacity > m_blocks;
+      std::array< std::uint32_t, Capacity > m_available;
+      std::size_t m_available_count;
+      std::size_t m_live_count;
+      bool m_detached;
+    };
+
+    // The allocator policy of the functions stored in the
+    // fixed_function_allocator of the calling thread. The allocator is
+    // created by the first call to instance() in the thread, which is the
+    // only memory allocation, thus real-time threads should call it during
+    // their initialization. The functions must not leave their thread.
+    template< std::size_t Capacity, std::size_t Size = 64 >
+    struct fixed_capacity_function_allocator
+    {
+      typedef fixed_function_allocator< Capacity, Size > allocator_type;
+      typedef typename allocator_type::allocation_handle allocation_handle;
+
+      // The pointer is constant-initialized and never destroyed, thus the
+      // allocator is still reachable from the thread-local objects
+      // destroyed after the end of its owner.
+      static allocator_type& instance()
+      {
+        thread_local allocator_type* allocator( nullptr );
+
+        if ( allocator == nullptr )
+          allocator = &create_instance();
+
+        return *allocator;
+      }
+
+    private:
+      // The allocator is not stored in the thread-local storage itself,
+      // which may be too small for it. It is detached when the thread
+      // exits.
+      struct thread_allocator
+      {
+        thread_allocator()
+          : allocator( new allocator_type() )
+        {
+
+        }
+
+        ~thread_allocator()
+        {
+          allocator->detach();
+        }
+
+        allocator_type* const allocator;
+      };
+
+      static allocator_type& create_instance()
+      {
+        thread_local const thread_allocator result;
+        return *result.allocator;
+      }
+    };
+  }
+}
@@ -1,101 +1,327 @@
 #pragma once
 
-#include "wfl/detail/function_allocator_storage.hpp"
+#include "wfl/detail/config.hpp"
 #include "wfl/detail/debug.hpp"
+#include "wfl/detail/function_allocator_storage.hpp"
+#include "wfl/detail/handle_sweep.hpp"
+#include "wfl/detail/mpsc_queue.hpp"
+#include "wfl/detail/scoped_pin.hpp"
+#include "wfl/detail/size_class_storage.hpp"
+#include "wfl/optional.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <type_traits>
+#include <vector>
 
 namespace wfl
 {
   namespace detail
   {
+    // An allocator used by a single thread. The owner of a handle is found
+    // from the directory of its storage, such that a handle released by
+    // another thread can be sent back to its owner. These releases are
+    // queued without locks and applied by the owner on its next
+    // allocation.
+    //
+    // The other uses of a handle from another thread are rejected: the
+    // function is seen as expired by is_alive() and safe_call(), while
+    // add_one() and call() throw std::logic_error.
     class function_allocator
     {
+      template< typename Storage >
+      friend class scoped_pin;
+
+    private:
+      typedef size_class_storage< function_allocator_storage > storage_type;
+
     public:
-      typedef
-      detail::function_allocator_storage::allocation_handle allocation_handle;
-  
+      typedef storage_type::allocation_handle allocation_handle;
+      typedef storage_type::function_storage function_storage;
+
     public:
-      template< typename... Args >
-      allocation_handle allocate( std::function< void( Args... ) > f )
-      {
-        static_assert
-          ( sizeof( std::function< void() > ) >= sizeof( f ),
-            "Function does not fit." );
-        static_assert
-          ( alignof( std::function< void() > )
-            % alignof( std::function< void( Args... ) > )
-            == 0,
-            "Function alignment does not match." );
-        
-        const typename function_allocator_storage::allocation_result result
-          ( m_storage.allocate() );
-        
-        new ( result.storage )
-          std::function< void( Args... ) >( std::move( f ) );
-    
+      function_allocator();
+
+      function_allocator( const function_allocator& ) = delete;
+      function_allocator& operator=( const function_allocator& ) = delete;
+
+      template< typename Signature, typename F >
+      allocation_handle allocate( F&& f )
+      {
+        constexpr std::size_t size_class
+          ( size_classes::of< typename std::decay< F >::type >::value );
+
+        if ( m_remote_count.load( std::memory_order_acquire ) != 0 )
+          release_remote_handles();
+
+        const storage_type::allocation_result< size_class > result
+          ( m_storage.allocate< size_class >() );
+
+        try
+          {
+            result.storage->template construct< Signature >
+              ( std::forward< F >( f ), *m_resource );
+          }
+        catch( ... )
+          {
+            m_storage.cancel< size_class >( result.handle );
+            throw;
+          }
+
         return result.handle;
       }
 
-      template< typename... Args >
-      void call( const allocation_handle& handle, Args&&... args ) const
+      // R and Args are the result and the parameters of the function's
+      // signature, A the types of the arguments, forwarded as is up to the
+      // function.
+      template< typename R, typename... Args, typename... A >
+      R call( const allocation_handle& handle, A&&... args )
       {
-        const typename function_allocator_storage::function_storage* const
-          function
-          ( m_storage.grab( handle ) );
+        const scoped_pin< function_allocator > function( *this, handle );
 
-        wfl_debug_assert( function != nullptr );
-        
-        typedef std::function< void( Args... ) > function_type;
-    
-        const function_type& typed_function
-          ( *reinterpret_cast< const function_type* >( function ) );
+        // The caller holds a reference to the function, thus it is alive
+        // unless it belongs to another thread.
+        if ( function.get() == nullptr )
+          throw_foreign_handle();
 
-        return typed_function( std::forward< Args >( args )... );
+        return function.get()->template invoke< R, Args... >
+          ( argument< Args >::pass( std::forward< A >( args ) )... );
       }
   
-      template< typename... Args >
-      void safe_call( const allocation_handle& handle, Args&&... args ) const
+      template< typename R, typename... Args, typename... A >
+      typename std::enable_if< std::is_void< R >::value >::type
+      safe_call( const allocation_handle& handle, A&&... args )
       {
-        const typename function_allocator_storage::function_storage* const
-          function
-          ( m_storage.grab( handle ) );
+        const scoped_pin< function_allocator > function( *this, handle );
+
+        if ( function.get() == nullptr )
+          {
+            ++m_expired_call_count;
+            return;
+          }
 
-        if ( function == nullptr )
-          return;
-        
-        typedef std::function< void( Args... ) > function_type;
-    
-        const function_type& typed_function
-          ( *reinterpret_cast< const function_type* >( function ) );
+        ++m_call_count;
 
-        return typed_function( std::forward< Args >( args )... );
+        function.get()->template invoke< R, Args... >
+          ( argument< Args >::pass( std::forward< A >( args ) )... );
       }
 
-      template< typename F >
-      void release_one( const allocation_handle& handle )
+      // The result of the function is constructed directly in the returned
+      // optional, which is empty if the function has expired.
+      template< typename R, typename... Args, typename... A >
+      typename std::enable_if< !std::is_void< R >::value, optional< R > >::type
+      safe_call( const allocation_handle& handle, A&&... args )
+      {
+        const scoped_pin< function_allocator > function( *this, handle );
+
+        if ( function.get() == nullptr )
+          {
+            ++m_expired_call_count;
+            return optional< R >();
+          }
+
+        ++m_call_count;
+
+        return optional< R >
+          ( in_place_invoke,
+            [ & ]() -> R
+            {
+              return function.get()->template invoke< R, Args... >
+                ( argument< Args >::pass( std::forward< A >( args ) )... );
+            } );
+      }
+
+      // Calls the functions of the given handles with the same arguments,
+      // in the order of their blocks, and returns the number of functions
+      // that were alive. The handles are sorted by this function and the
+      // ones of the expired functions are removed.
+      template< typename R, typename... Args >
+      std::size_t safe_call_all
+      ( std::vector< allocation_handle >& handles,
+        typename std::add_lvalue_reference< Args >::type... args )
+      {
+        return safe_call_all_until< R, Args... >
+          ( handles, never_stop(), args... );
+      }
+
+      // Like safe_call_all(), but stops before the next function as soon
+      // as stop() returns true. The handles not visited are kept.
+      template< typename R, typename... Args, typename Stop >
+      std::size_t safe_call_all_until
+      ( std::vector< allocation_handle >& handles, const Stop& stop,
+        typename std::add_lvalue_reference< Args >::type... args )
       {
-        const typename function_allocator_storage::function_storage* const
-          function
-          ( m_storage.release_one( handle ) );
+        const block_order order( size_classes::count_log2 );
+
+        if ( !std::is_sorted( handles.begin(), handles.end(), order ) )
+          std::sort( handles.begin(), handles.end(), order );
+
+        std::size_t visited( 0 );
+        std::size_t result( 0 );
+
+        {
+          handle_sweep sweep( handles );
+
+          for ( ; !sweep.done() && !stop(); ++visited )
+            {
+              const allocation_handle handle( sweep.next() );
+              const scoped_pin< function_allocator > function
+                ( *this, handle );
+
+              if ( function.get() == nullptr )
+                continue;
+
+              sweep.keep( handle );
+              ++result;
+              function.get()->template invoke< R, Args... >
+                ( repeated_argument< Args >::pass( args )... );
+            }
+        }
 
-        if ( function == nullptr )
-          return;
+        m_call_count += result;
+        m_expired_call_count += visited - result;
 
-        reinterpret_cast< const F* >( function )->~F();
+        return result;
+      }
+
+      bool is_alive( const allocation_handle& handle )
+      {
+        return m_storage.is_alive( handle );
+      }
+
+      // The handle can come from the allocator of another thread, in which
+      // case it is queued for its owner.
+      void release_one( const allocation_handle& handle )
+      {
+        if ( !m_storage.release_one( handle ) )
+          static_cast< function_allocator* >( storage_type::owner( handle ) )
+            ->release_remote( handle );
       }
 
       void add_one( const allocation_handle& handle )
       {
-        m_storage.add_one( handle );
+        if ( !m_storage.add_one( handle ) )
+          throw_foreign_handle();
       }
-  
+
+      allocator_statistics statistics()
+      {
+        allocator_statistics result( m_storage.statistics() );
+
+        result.call_count = m_call_count;
+        result.expired_call_count = m_expired_call_count;
+
+        return result;
+      }
+
+      // Prepares the storage for count functions whose callable is at most
+      // size bytes, such that their allocation does not grow the storage.
+      void reserve( std::size_t count, std::size_t size )
+      {
+        m_storage.reserve( size_classes::of_size( size ), count );
+      }
+
+      // When enabled, the functions are not destroyed when their last
+      // reference is released but in batches, by collect(), trim() or
+      // when the mode is disabled.
+      void defer_destruction( bool enabled )
+      {
+        m_storage.defer_destruction( enabled );
+      }
+
+      // Destroys the functions released in deferred mode, including the
+      // ones released by other threads.
+      void collect()
+      {
+        if ( m_remote_count.load( std::memory_order_acquire ) != 0 )
+          release_remote_handles();
+
+        m_storage.collect();
+      }
+
+      // Releases the memory of the free blocks at the end of the storage.
+      void trim()
+      {
+        if ( m_remote_count.load( std::memory_order_acquire ) != 0 )
+          release_remote_handles();
+
+        m_storage.trim();
+      }
+
+      void shrink_to_fit()
+      {
+        if ( m_remote_count.load( std::memory_order_acquire ) != 0 )
+          release_remote_handles();
+
+        m_storage.shrink_to_fit();
+      }
+
+      // Called when the thread owning this allocator exits. The allocator
+      // is destroyed if there is no function left in it, otherwise it is
+      // abandoned and the remaining functions are destroyed by the threads
+      // releasing them.
+      void detach();
+
     private:
-      detail::function_allocator_storage m_storage;
+      const function_storage* pin( const allocation_handle& handle )
+      {
+        return m_storage.pin( handle );
+      }
+
+      void unpin( const allocation_handle& handle )
+      {
+        m_storage.unpin( handle );
+      }
+
+      [[noreturn]] static void throw_foreign_handle();
+
+      // Called by another thread than the owner to release the handle.
+      void release_remote( const allocation_handle& handle );
+
+      void release_remote_handles();
+      void release_remote_handles_if_abandoned();
+
+      // Marks the end of the use of the allocator by a thread which is not
+      // its owner, or by the owner in detach().
+      void leave();
+
+    private:
+      memory_resource* const m_resource;
+      storage_type m_storage;
+
+      std::uint64_t m_call_count;
+      std::uint64_t m_expired_call_count;
+
+      // The nodes of the blocks released by other threads.
+      mpsc_queue m_remote_handles;
+
+      // The number of releases counted in the nodes of the blocks, queued
+      // or about to be, and not yet applied.
+      std::atomic< std::size_t > m_remote_count;
+
+      // Twice the number of threads in release_remote() or detach(), plus
+      // one once the allocator is abandoned and has no function left. No
+      // thread can enter it afterwards, thus the last one to leave it
+      // deletes it.
+      std::atomic< std::size_t > m_users;
+
+      // Set when the owning thread has exited. The queue is then consumed
+      // by the releasing threads, one at a time.
+      std::atomic< bool > m_abandoned;
+      std::atomic< bool > m_consuming;
     };
 
     struct thread_local_function_allocator
     {
       typedef function_allocator::allocation_handle allocation_handle;
       static function_allocator& instance();
+
+    private:
+      static function_allocator& create_instance();
     };
   }
 }
+
+#ifdef WFL_HEADER_ONLY
+  #include "wfl/detail/impl/function_allocator.ipp"
+#endif
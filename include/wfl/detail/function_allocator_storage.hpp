@@ -1,38 +1,58 @@
 #pragma once
 
-#include <deque>
-#include <functional>
-#include <type_traits>
+#include "wfl/detail/allocation_handle.hpp"
+#include "wfl/detail/allocator_statistics.hpp"
+#include "wfl/detail/callable_storage.hpp"
+#include "wfl/detail/config.hpp"
+#include "wfl/detail/mpsc_queue.hpp"
+#include "wfl/detail/page.hpp"
+#include "wfl/detail/resource_allocator.hpp"
+
+#include <atomic>
+#include <mutex>
 #include <vector>
 
 namespace wfl
 {
   namespace detail
   {
+    // The node through which the other threads queue their releases of a
+    // block for its owner. The count is the number of releases not applied
+    // yet, and the node is queued when the count leaves zero, such that a
+    // block is never twice in the queue.
+    struct remote_release:
+      mpsc_node
+    {
+      std::atomic< std::uint32_t > count{ 0 };
+
+      // The id of the handle of the block, set by the thread queuing the
+      // node.
+      std::uint32_t id;
+    };
+
+    // Storage for the functions whose size fit in Size bytes, used by a
+    // single thread. The blocks are stored in pages of a power of two size
+    // taken from a directory shared by all the storages of this size, such
+    // that the owner of a block is found from its id by any thread.
+    template< std::size_t Size >
     class function_allocator_storage
     {
     public:
-      static constexpr int not_a_version = 0;
-  
-      struct allocation_handle
+      typedef detail::allocation_handle allocation_handle;
+      typedef sized_callable_storage< Size > function_storage;
+
+      // The metadata used to validate a handle, kept apart from the
+      // callables such that a validity check does not load the callable.
+      struct block_state
       {
-        int version = not_a_version;
-        std::size_t id;
+        std::uint32_t version = allocation_handle::not_a_version;
+        std::uint32_t ref_count = 0;
       };
-  
-      typedef
-      std::aligned_storage
-      <
-        sizeof( std::function< void() > ),
-        alignof( std::function< void() > )
-      >::type
-      function_storage;
 
       struct block
       {
         function_storage storage;
-        int version = not_a_version;
-        char ref_count = 0;
+        std::uint32_t pin_count = 0;
       };
 
       struct allocation_result
@@ -42,14 +62,178 @@ namespace wfl
       };
         
     public:
+      // The memory of the blocks comes from the default memory resource
+      // at the time of the construction.
+      function_allocator_storage();
+      ~function_allocator_storage();
+
+      function_allocator_storage( const function_allocator_storage& ) = delete;
+      function_allocator_storage&
+      operator=( const function_allocator_storage& ) = delete;
+
+      // Sets the value returned by owner() for the blocks of this storage.
+      // Must be called before the first allocation.
+      void set_owner( void* owner );
+
+      // Returns the owner of the storage holding the block of the handle.
+      // This can be called from any thread while the handle is alive.
+      static void* owner( const allocation_handle& handle );
+
+      // Returns the node through which another thread than the owner
+      // releases the block of the handle.
+      static remote_release& remote_node( const allocation_handle& handle );
+
       allocation_result allocate();
-      const function_storage* grab( const allocation_handle& handle ) const;
-      function_storage* release_one( const allocation_handle& handle );
-      void add_one( const allocation_handle& handle );
+
+      // Gives back the block of an allocation whose callable could not be
+      // constructed.
+      void cancel( const allocation_handle& handle );
+
+      // Returns false, without any effect, if the block of the handle
+      // belongs to another storage.
+      bool release_one( const allocation_handle& handle );
+      bool add_one( const allocation_handle& handle );
+
+      // Applies count releases of the handle at once.
+      void release( const allocation_handle& handle, std::uint32_t count );
+
+      // The blocks of the other storages are seen as expired.
+      bool is_alive( const allocation_handle& handle ) const;
+      const function_storage* pin( const allocation_handle& handle );
+
+      void unpin( const allocation_handle& handle );
+
+      // The number of blocks whose function has not been destroyed yet.
+      std::size_t live_count() const;
+
+      allocator_statistics statistics() const;
+
+      // Creates the blocks such that the next allocations do not grow the
+      // storage until there are count functions in it.
+      void reserve( std::size_t count );
+
+      // When enabled, the functions whose last reference is released are
+      // not destroyed until the next call to collect(). Disabling the mode
+      // collects the pending functions.
+      void defer_destruction( bool enabled );
+
+      // Destroys the functions released in deferred mode, including the
+      // ones released by these destructors.
+      void collect();
+
+      // Gives back the pages whose blocks are all free. The functions
+      // released in deferred mode are collected first.
+      void trim();
+
+      // Trims the storage and releases the unused capacity of the
+      // containers.
+      void shrink_to_fit();
+
+    private:
+      static constexpr std::size_t page_size_log2 = 6;
+      static constexpr std::size_t page_size = 1 << page_size_log2;
+
+      // The entries of the directory are allocated by chunks, never freed.
+      static constexpr std::size_t chunk_size_log2 = 10;
+      static constexpr std::size_t chunk_size = 1 << chunk_size_log2;
+      static constexpr std::size_t max_page_count =
+        allocation_handle::max_storage_block_count >> page_size_log2;
+      static constexpr std::size_t max_chunk_count =
+        max_page_count >> chunk_size_log2;
+
+      // A page of the directory. The states are kept when the page is given
+      // back, thus the versions of its blocks continue from their last
+      // value when it is taken by another storage. The remote nodes are
+      // apart from the blocks since they are rarely used. The next free
+      // page is meaningful only when the page has no owner.
+      struct page_entry
+      {
+        std::atomic< void* > owner;
+        std::atomic< block_state* > states;
+        std::atomic< block* > blocks;
+        std::atomic< remote_release* > remote_nodes;
+        std::uint32_t next_free;
+      };
+
+      template< typename T >
+      using resource_vector = std::vector< T, resource_allocator< T > >;
+
+    private:
+      // Returns the entry of the page of the block if the page belongs to
+      // this storage, nullptr otherwise.
+      const page_entry* owned_entry( std::size_t id ) const;
+
+      static page_entry& get_entry( std::size_t page );
+      static block_state& get_state( std::size_t id );
+      static block& get_block( std::size_t id );
+
+      // Takes a page without owner from the directory, or creates a new
+      // one.
+      static std::uint32_t take_free_page();
+
+      std::size_t grow();
+      void take_page();
+      void give_back_page( std::uint32_t page );
+      void recycle( std::size_t id );
+      void destroy( std::size_t id );
   
     private:
-      std::deque< block > m_blocks;
-      std::vector< std::size_t > m_available;
+      // The directory of the pages, shared by all the storages of this
+      // size. The members are constant-initialized, thus they can be read
+      // without any guard. The states and the chunks come from
+      // new_delete_resource() since they outlive the storages.
+      static std::atomic< page_entry* > s_chunks[ max_chunk_count ];
+      static std::mutex s_mutex;
+      static std::uint32_t s_page_count;
+
+      // The index plus one of the first page without owner, zero if there
+      // is none.
+      static std::uint32_t s_free_page;
+
+    private:
+      memory_resource* const m_resource;
+      void* m_owner;
+
+      // The pages taken by this storage, and the range of the ids of the
+      // last page never allocated yet.
+      resource_vector< std::uint32_t > m_pages;
+      std::size_t m_next_id;
+      std::size_t m_end_id;
+
+      resource_vector< std::size_t > m_available;
+
+      bool m_deferred_destruction;
+      resource_vector< std::size_t > m_retired;
+
+      std::size_t m_live_count = 0;
+      std::size_t m_peak_live_count = 0;
+      std::uint64_t m_allocation_count = 0;
+      std::uint64_t m_release_count = 0;
     };
   }
 }
+
+#ifdef WFL_HEADER_ONLY
+  #include "wfl/detail/impl/function_allocator_storage.ipp"
+#else
+// The size classes are the default ones, or the halves of a larger
+// WFL_INLINE_CALLABLE_SIZE.
+#if WFL_INLINE_CALLABLE_SIZE > 256
+extern template class wfl::detail::function_allocator_storage
+  < WFL_INLINE_CALLABLE_SIZE / 16 >;
+extern template class wfl::detail::function_allocator_storage
+  < WFL_INLINE_CALLABLE_SIZE / 8 >;
+extern template class wfl::detail::function_allocator_storage
+  < WFL_INLINE_CALLABLE_SIZE / 4 >;
+extern template class wfl::detail::function_allocator_storage
+  < WFL_INLINE_CALLABLE_SIZE / 2 >;
+extern template class wfl::detail::function_allocator_storage
+  < WFL_INLINE_CALLABLE_SIZE >;
+#else
+extern template class wfl::detail::function_allocator_storage< 16 >;
+extern template class wfl::detail::function_allocator_storage< 32 >;
+extern template class wfl::detail::function_allocator_storage< 64 >;
+extern template class wfl::detail::function_allocator_storage< 128 >;
+extern template class wfl::detail::function_allocator_storage< 256 >;
+#endif
+#endif
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "wfl/detail/config.hpp"
+#include "wfl/detail/function_group_storage.hpp"
+#include "wfl/detail/thread_safe_function_allocator.hpp"
+#include "wfl/detail/weak_function.hpp"
+
+#include <cstdint>
+
+namespace wfl
+{
+  namespace detail
+  {
+    // Thread-safe functions sharing the lifetime of the group they were
+    // added to. Expiring the group, or destroying it, expires all its
+    // functions at once instead of releasing them one by one, then their
+    // callables are destroyed in a single pass once no caller can observe
+    // them anymore.
+    //
+    // The functions of a group can be called from any thread, but the group
+    // itself must be used by one thread at a time.
+    //
+    // A group holds at most max_size functions, in blocks of 32 bytes. The
+    // larger callables are allocated from the memory resource. Objects
+    // needing more functions can use several groups.
+    //
+    // The blocks of an expired group are freed with its callables, or by
+    // the trim() and shrink_to_fit() of the allocator when the destruction
+    // is deferred. The small record of each group ever created is kept
+    // and reused by the next groups, it is never freed.
+    class function_group
+    {
+    public:
+      static constexpr std::size_t max_size =
+        function_group_storage::max_group_size;
+
+    public:
+      function_group();
+      ~function_group();
+
+      function_group( const function_group& ) = delete;
+      function_group& operator=( const function_group& ) = delete;
+
+      // Stores f in the group and returns a reference to it, which expires
+      // with the group. Throws std::bad_alloc if the group already holds
+      // max_size functions.
+      template< typename Signature, typename F >
+      weak_function< Signature, thread_safe_function_allocator > add( F&& f )
+      {
+        mt_function_allocator& allocator
+          ( thread_safe_function_allocator::instance() );
+
+        if ( m_group == function_group_storage::not_a_group )
+          m_group = allocator.create_group();
+
+        const weak_function< Signature, thread_safe_function_allocator >
+          result
+          ( allocator.allocate_in_group< Signature >
+            ( m_group, std::forward< F >( f ) ) );
+
+        ++m_size;
+        return result;
+      }
+
+      // Expires all the functions of the group. New functions can be added
+      // afterwards.
+      void expire();
+
+      // The number of functions added since the last expiration.
+      std::size_t size() const;
+
+    private:
+      // The group is created in the storage by the first addition.
+      std::uint32_t m_group;
+      std::size_t m_size;
+    };
+  }
+}
+
+#ifdef WFL_HEADER_ONLY
+  #include "wfl/detail/impl/function_group.ipp"
+#endif
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "wfl/detail/allocation_handle.hpp"
+#include "wfl/detail/callable_storage.hpp"
+#include "wfl/detail/config.hpp"
+#include "wfl/detail/epoch_domain.hpp"
+#include "wfl/detail/resource_allocator.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace wfl
+{
+  namespace detail
+  {
+    // Thread-safe storage for the functions of the groups. Each group has
+    // a record holding its generation and its own pages of blocks. The
+    // handles of the functions of a group carry the generation of the
+    // group, thus changing the generation expires all of them at once,
+    // then their callables are destroyed in a single pass over the pages
+    // of the group, once no reader can observe them anymore.
+    //
+    // The functions of a group have no reference count: they live as long
+    // as their group.
+    class function_group_storage
+    {
+    public:
+      typedef detail::allocation_handle allocation_handle;
+      typedef sized_callable_storage< 32 > function_storage;
+
+      // The index of the block in its group is stored in the low bits of
+      // the handles' ids, the index of the group in the remaining bits.
+      static constexpr std::size_t block_id_bits = 8;
+      static constexpr std::size_t max_group_size =
+        std::size_t( 1 ) << block_id_bits;
+
+      static constexpr std::uint32_t not_a_group = 0xffffffff;
+
+    public:
+      // The memory of the blocks and of the containers comes from the
+      // default memory resource at the time of the construction.
+      function_group_storage();
+      ~function_group_storage();
+
+      function_group_storage( const function_group_storage& ) = delete;
+      function_group_storage&
+      operator=( const function_group_storage& ) = delete;
+
+      // Returns the index of a new, empty group.
+      std::uint32_t create();
+
+      // Stores f in the given group and returns its handle. Throws
+      // std::bad_alloc if the group is full. The functions of a group must
+      // not be allocated concurrently with each other or with the release
+      // of the group.
+      template< typename Signature, typename F >
+      allocation_handle allocate( std::uint32_t group, F&& f )
+      {
+        function_storage& storage( next_block( group ) );
+
+        storage.template construct< Signature >
+          ( std::forward< F >( f ), *m_resource );
+
+        return commit( group );
+      }
+
+      // Expires all the functions of the group and retires its blocks. The
+      // index of the group must not be used anymore after this call.
+      void release( std::uint32_t group );
+
+      bool is_alive( const allocation_handle& handle ) const;
+      const function_storage* pin( const allocation_handle& handle );
+
+      // Returns the function of the handle if it is alive. The calling
+      // thread must be in an epoch_section, which keeps the function alive.
+      const function_storage* lookup( const allocation_handle& handle ) const;
+
+      void unpin( const allocation_handle& handle );
+
+      // Destroys the functions of the released groups that cannot be
+      // observed anymore, if no other thread is doing it and if the
+      // destruction is not deferred.
+      void try_reclaim();
+
+      // When enabled, the functions of the released groups are destroyed
+      // only by collect(). Disabling the mode collects the pending
+      // functions.
+      void defer_destruction( bool enabled );
+
+      // Destroys the functions of the released groups that cannot be
+      // observed anymore, waiting for the lock if needed.
+      void collect();
+
+      // Releases the pages of blocks of the released groups that cannot be
+      // observed anymore. The records of the groups are never released,
+      // such that the handles of a released group can still be checked.
+      void trim();
+
+      void shrink_to_fit();
+
+    private:
+      static constexpr std::size_t block_page_size_log2 = 4;
+      static constexpr std::size_t block_page_size =
+        1 << block_page_size_log2;
+      static constexpr std::size_t block_page_count =
+        max_group_size / block_page_size;
+
+      static constexpr std::size_t group_page_size_log2 = 6;
+      static constexpr std::size_t group_page_size =
+        1 << group_page_size_log2;
+      static constexpr std::size_t max_group_page_count =
+        ( allocation_handle::max_storage_block_count >> block_id_bits )
+        / group_page_size;
+
+      // The generation changes when the group is released, and is the
+      // version of the handles of its functions. The pages of blocks are
+      // set by the thread owning the group and read by the callers.
+      struct group_record
+      {
+        std::atomic< std::uint32_t > generation;
+        std::atomic< function_storage* > pages[ block_page_count ];
+        std::size_t size;
+      };
+
+      // The blocks of a released group, waiting for the readers to leave.
+      struct retired_group
+      {
+        epoch_domain::epoch_type epoch;
+        std::size_t size;
+        function_storage* pages[ block_page_count ];
+      };
+
+      template< typename T >
+      using resource_vector = std::vector< T, resource_allocator< T > >;
+
+    private:
+      group_record& get_record( std::uint32_t group ) const;
+      function_storage& next_block( std::uint32_t group );
+      allocation_handle commit( std::uint32_t group );
+      void destroy( const retired_group& group );
+      void reclaim( std::unique_lock< std::mutex >& lock );
+
+    private:
+      // The pages of the records are never freed, thus a handle can be
+      // checked after the release of its group. The records of the
+      // released groups are reused with a new generation.
+      memory_resource* const m_resource;
+      std::atomic< group_record* > m_group_pages[ max_group_page_count ];
+      std::size_t m_group_count;
+      resource_vector< std::uint32_t > m_available;
+      std::mutex m_mutex;
+      std::atomic< bool > m_deferred_destruction;
+
+      std::atomic< std::size_t > m_retired_count;
+      resource_vector< retired_group > m_retired;
+    };
+  }
+}
+
+#ifdef WFL_HEADER_ONLY
+  #include "wfl/detail/impl/function_group_storage.ipp"
+#endif
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "wfl/detail/allocation_handle.hpp"
+
+#include <vector>
+
+namespace wfl
+{
+  namespace detail
+  {
+    // The stop condition of a batch of calls running until the end of its
+    // handles.
+    struct never_stop
+    {
+      bool operator()() const
+      {
+        return false;
+      }
+    };
+
+    // Visits the handles of a vector in order and compacts the ones marked
+    // with keep() at the beginning of the vector. The handles not kept are
+    // removed when the sweep is destroyed, and if the sweep is interrupted
+    // by an exception the handles not visited yet are kept.
+    class handle_sweep
+    {
+    public:
+      explicit handle_sweep( std::vector< allocation_handle >& handles )
+        : m_handles( handles ),
+          m_kept( 0 ),
+          m_next( 0 )
+      {
+
+      }
+
+      ~handle_sweep()
+      {
+        m_handles.erase
+          ( m_handles.begin() + m_kept, m_handles.begin() + m_next );
+      }
+
+      handle_sweep( const handle_sweep& ) = delete;
+      handle_sweep& operator=( const handle_sweep& ) = delete;
+
+      bool done() const
+      {
+        return m_next == m_handles.size();
+      }
+
+      allocation_handle next()
+      {
+        return m_handles[ m_next++ ];
+      }
+
+      // Keeps the handle returned by the last call to next().
+      void keep( const allocation_handle& handle )
+      {
+        m_handles[ m_kept ] = handle;
+        ++m_kept;
+      }
+
+    private:
+      std::vector< allocation_handle >& m_handles;
+      std::size_t m_kept;
+      std::size_t m_next;
+    };
+  }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "wfl/detail/allocator_statistics.hpp"
+
+wfl_inline wfl::detail::allocator_statistics&
+wfl::detail::allocator_statistics::operator+=
+( const allocator_statistics& that )
+{
+  live_count += that.live_count;
+  peak_live_count += that.peak_live_count;
+  allocation_count += that.allocation_count;
+  release_count += that.release_count;
+  call_count += that.call_count;
+  expired_call_count += that.expired_call_count;
+  available_count += that.available_count;
+  page_count += that.page_count;
+  contention_count += that.contention_count;
+  lock_wait_time += that.lock_wait_time;
+
+  return *this;
+}
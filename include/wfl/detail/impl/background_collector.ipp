@@ -0,0 +1,44 @@
+#pragma once
+
+#include "wfl/detail/background_collector.hpp"
+
+#include "wfl/detail/thread_safe_function_allocator.hpp"
+
+wfl_inline wfl::detail::background_collector::background_collector
+( std::chrono::milliseconds period )
+  : m_period( period ),
+    m_stop( false )
+{
+  thread_safe_function_allocator::instance().defer_destruction( true );
+  m_thread = std::thread( &background_collector::run, this );
+}
+
+wfl_inline wfl::detail::background_collector::~background_collector()
+{
+  {
+    const std::lock_guard< std::mutex > lock( m_mutex );
+    m_stop = true;
+  }
+
+  m_condition.notify_one();
+  m_thread.join();
+
+  thread_safe_function_allocator::instance().defer_destruction( false );
+}
+
+wfl_inline void wfl::detail::background_collector::run()
+{
+  mt_function_allocator& allocator
+    ( thread_safe_function_allocator::instance() );
+  std::unique_lock< std::mutex > lock( m_mutex );
+
+  while ( !m_condition.wait_for
+          ( lock, m_period, [ this ]() -> bool { return m_stop; } ) )
+    {
+      // The functions are destroyed without the lock such that the
+      // destructor of this object does not wait for them.
+      lock.unlock();
+      allocator.collect();
+      lock.lock();
+    }
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "wfl/detail/call_dispatcher.hpp"
+
+#include <algorithm>
+
+wfl_inline std::uint64_t
+wfl::detail::call_dispatcher::key( const allocation_handle& handle )
+{
+  return ( std::uint64_t( handle.id ) << 32 ) | handle.version;
+}
+
+wfl_inline wfl::detail::allocation_handle
+wfl::detail::call_dispatcher::handle_of( std::uint64_t key )
+{
+  allocation_handle result;
+  result.version = std::uint32_t( key );
+  result.id = std::uint32_t( key >> 32 );
+
+  return result;
+}
+
+wfl_inline std::size_t
+wfl::detail::call_dispatcher::first_slot( std::uint64_t key )
+{
+  // The low bits of the ids are the size class and the shard, thus the
+  // key is mixed before selecting the slot.
+  return ( key * 0x9e3779b97f4a7c15ull ) >> ( 64 - slot_count_log2 );
+}
+
+wfl_inline wfl::detail::call_dispatcher::call_dispatcher()
+  : m_posted_count( 0 )
+{
+  for ( std::size_t i( 0 ); i != slot_count; ++i )
+    m_slots[ i ].store( 0, std::memory_order_relaxed );
+}
+
+wfl_inline wfl::detail::call_dispatcher::~call_dispatcher()
+{
+  while ( mpsc_node* const node = m_overflow.pop() )
+    delete static_cast< posted_call* >( node );
+}
+
+wfl_inline void
+wfl::detail::call_dispatcher::post( const function_type& f )
+{
+  if ( f.m_handle.version == allocation_handle::not_a_version )
+    return;
+
+  if ( post_in_slot( key( f.m_handle ) ) )
+    return;
+
+  posted_call* const call( new posted_call() );
+  call->handle = f.m_handle;
+
+  m_overflow.push( *call );
+}
+
+wfl_inline bool wfl::detail::call_dispatcher::post_in_slot( std::uint64_t key )
+{
+  std::size_t slot( first_slot( key ) );
+
+  for ( std::size_t i( 0 ); i != max_probe_count;
+        ++i, slot = ( slot + 1 ) & ( slot_count - 1 ) )
+    {
+      std::uint64_t current
+        ( m_slots[ slot ].load( std::memory_order_relaxed ) );
+
+      // The key is written again when it is already there, such that the
+      // post is ordered with the exchange of the dispatch: either the
+      // dispatch takes the key after this write and sees the writes done
+      // before the post, or the key was taken before and it is posted
+      // again.
+      while ( ( current == 0 ) || ( current == key ) )
+        {
+          const bool inserted( current == 0 );
+
+          if ( m_slots[ slot ].compare_exchange_weak
+               ( current, key, std::memory_order_acq_rel,
+                 std::memory_order_relaxed ) )
+            {
+              // The count is released after the key such that a dispatch
+              // seeing the count sees the key too.
+              if ( inserted )
+                m_posted_count.fetch_add( 1, std::memory_order_release );
+
+              return true;
+            }
+        }
+    }
+
+  return false;
+}
+
+wfl_inline std::size_t wfl::detail::call_dispatcher::dispatch()
+{
+  m_handles.clear();
+
+  while ( mpsc_node* const node = m_overflow.pop() )
+    {
+      posted_call* const call( static_cast< posted_call* >( node ) );
+      m_handles.emplace_back( call->handle );
+      delete call;
+    }
+
+  if ( m_posted_count.load( std::memory_order_acquire ) != 0 )
+    {
+      std::size_t taken( 0 );
+
+      for ( std::atomic< std::uint64_t >& slot : m_slots )
+        {
+          const std::uint64_t posted
+            ( slot.exchange( 0, std::memory_order_acq_rel ) );
+
+          if ( posted == 0 )
+            continue;
+
+          m_handles.emplace_back( handle_of( posted ) );
+          ++taken;
+        }
+
+      m_posted_count.fetch_sub( taken, std::memory_order_relaxed );
+    }
+
+  if ( m_handles.empty() )
+    return 0;
+
+  std::sort
+    ( m_handles.begin(), m_handles.end(),
+      []( const allocation_handle& a, const allocation_handle& b ) -> bool
+      {
+        return key( a ) < key( b );
+      } );
+
+  m_handles.erase
+    ( std::unique
+      ( m_handles.begin(), m_handles.end(),
+        []( const allocation_handle& a, const allocation_handle& b ) -> bool
+        {
+          return key( a ) == key( b );
+        } ),
+      m_handles.end() );
+
+  // A function posting during its call lands in the queue, for the next
+  // dispatch, thus m_handles is not modified during the calls.
+  return thread_safe_function_allocator::instance().safe_call_all< void >
+    ( m_handles );
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "wfl/detail/epoch_domain.hpp"
+
+#include "wfl/detail/aligned_allocation.hpp"
+#include "wfl/detail/debug.hpp"
+
+#include <atomic>
+
+namespace wfl
+{
+  namespace detail
+  {
+    // The epoch announced by a thread, zero when the thread is not in a
+    // critical section. The records are never freed, they are reused by
+    // the threads created after the death of their owner.
+    struct alignas( 64 ) epoch_record
+    {
+      std::atomic< epoch_domain::epoch_type > epoch;
+      std::atomic< bool > in_use;
+      epoch_record* next;
+      unsigned int depth;
+    };
+
+    class epoch_record_owner
+    {
+    public:
+      epoch_record_owner();
+      ~epoch_record_owner();
+
+      epoch_record& record;
+
+    private:
+      static epoch_record& acquire();
+    };
+
+    wfl_inline std::atomic< epoch_domain::epoch_type >& global_epoch()
+    {
+      static std::atomic< epoch_domain::epoch_type > result( 1 );
+      return result;
+    }
+
+    wfl_inline std::atomic< epoch_record* >& epoch_records()
+    {
+      static std::atomic< epoch_record* > result( nullptr );
+      return result;
+    }
+
+    wfl_inline epoch_record& this_thread_epoch_record()
+    {
+      thread_local const epoch_record_owner owner;
+      return owner.record;
+    }
+  }
+}
+
+wfl_inline wfl::detail::epoch_record_owner::epoch_record_owner()
+  : record( acquire() )
+{
+
+}
+
+wfl_inline wfl::detail::epoch_record_owner::~epoch_record_owner()
+{
+  wfl_debug_assert( record.depth == 0 );
+  record.in_use.store( false, std::memory_order_release );
+}
+
+wfl_inline wfl::detail::epoch_record&
+wfl::detail::epoch_record_owner::acquire()
+{
+  for ( epoch_record* r( epoch_records().load( std::memory_order_acquire ) );
+        r != nullptr; r = r->next )
+    {
+      bool expected( false );
+
+      if ( r->in_use.compare_exchange_strong( expected, true ) )
+        return *r;
+    }
+
+  // The records are aligned on a cache line to avoid the false sharing of
+  // the epochs announced by the threads.
+  epoch_record* const result( aligned_new< epoch_record >() );
+  result->epoch.store( 0, std::memory_order_relaxed );
+  result->in_use.store( true, std::memory_order_relaxed );
+  result->depth = 0;
+  result->next = epoch_records().load( std::memory_order_relaxed );
+
+  while ( !epoch_records().compare_exchange_weak
+          ( result->next, result, std::memory_order_release,
+            std::memory_order_relaxed ) );
+
+  return *result;
+}
+
+wfl_inline void wfl::detail::epoch_domain::enter()
+{
+  epoch_record& record( this_thread_epoch_record() );
+
+  if ( record.depth++ != 0 )
+    return;
+
+  // The announcement must be visible before the reader looks at any block,
+  // hence the sequential consistency.
+  record.epoch.store( global_epoch().load() );
+}
+
+wfl_inline bool wfl::detail::epoch_domain::leave()
+{
+  epoch_record& record( this_thread_epoch_record() );
+
+  wfl_debug_assert( record.depth != 0 );
+
+  if ( --record.depth != 0 )
+    return false;
+
+  record.epoch.store( 0, std::memory_order_release );
+  return true;
+}
+
+wfl_inline wfl::detail::epoch_domain::epoch_type
+wfl::detail::epoch_domain::current()
+{
+  return global_epoch().load();
+}
+
+wfl_inline wfl::detail::epoch_domain::epoch_type
+wfl::detail::epoch_domain::synchronize()
+{
+  epoch_type result( global_epoch().fetch_add( 1 ) + 1 );
+
+  for ( const epoch_record* r
+          ( epoch_records().load( std::memory_order_acquire ) );
+        r != nullptr; r = r->next )
+    {
+      const epoch_type epoch( r->epoch.load() );
+
+      if ( ( epoch != 0 ) && ( epoch < result ) )
+        result = epoch;
+    }
+
+  return result;
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "wfl/detail/function_allocator.hpp"
+
+#include <new>
+#include <stdexcept>
+
+namespace wfl
+{
+  namespace detail
+  {
+    // Detaches the allocator of the thread when the thread exits.
+    struct thread_allocator
+    {
+      thread_allocator()
+        : allocator( new function_allocator() )
+      {
+
+      }
+
+      ~thread_allocator()
+      {
+        allocator->detach();
+      }
+
+      function_allocator* const allocator;
+    };
+  }
+}
+
+wfl_inline wfl::detail::function_allocator::function_allocator()
+  : m_resource( get_default_resource() ),
+    m_call_count( 0 ),
+    m_expired_call_count( 0 ),
+    m_remote_count( 0 ),
+    m_users( 0 ),
+    m_abandoned( false ),
+    m_consuming( false )
+{
+  m_storage.set_owner( this );
+}
+
+wfl_inline void wfl::detail::function_allocator::detach()
+{
+  // The thread counts as a user such that the allocator is not deleted by
+  // a releasing thread before the end of this function.
+  m_users += 2;
+
+  release_remote_handles();
+
+  // Nobody would collect the functions released after the exit of the
+  // thread.
+  m_storage.defer_destruction( false );
+
+  if ( m_storage.live_count() == 0 )
+    m_users |= 1;
+
+  m_abandoned.store( true );
+  release_remote_handles_if_abandoned();
+  leave();
+}
+
+wfl_inline void wfl::detail::function_allocator::throw_foreign_handle()
+{
+  throw std::logic_error
+    ( "wfl: a thread-local function was used from another thread than the"
+      " one that created it." );
+}
+
+wfl_inline void wfl::detail::function_allocator::release_remote
+( const allocation_handle& handle )
+{
+  m_users += 2;
+  ++m_remote_count;
+
+  // The node is queued by the first release since its last consumption;
+  // the next ones are counted in it.
+  remote_release& node( storage_type::remote_node( handle ) );
+
+  if ( node.count.fetch_add( 1, std::memory_order_acq_rel ) == 0 )
+    {
+      node.id = handle.id;
+      m_remote_handles.push( node );
+    }
+
+  release_remote_handles_if_abandoned();
+  leave();
+}
+
+wfl_inline void wfl::detail::function_allocator::release_remote_handles()
+{
+  while ( mpsc_node* const node = m_remote_handles.pop() )
+    {
+      remote_release& remote( static_cast< remote_release& >( *node ) );
+
+      // The id is read before the reset of the count, after which another
+      // thread may queue the node again. The version is not checked by the
+      // release, it must only differ from not_a_version.
+      allocation_handle handle;
+      handle.version = allocation_handle::last_version;
+      handle.id = remote.id;
+
+      const std::uint32_t count
+        ( remote.count.exchange( 0, std::memory_order_acq_rel ) );
+
+      m_remote_count -= count;
+      m_storage.release( handle, count );
+    }
+}
+
+wfl_inline void
+wfl::detail::function_allocator::release_remote_handles_if_abandoned()
+{
+  // The consumer checks the count again after leaving, such that a handle
+  // pushed while it was finishing is not left in the queue.
+  while ( m_abandoned.load() && ( m_remote_count.load() != 0 ) )
+    {
+      if ( m_consuming.exchange( true, std::memory_order_acquire ) )
+        return;
+
+      release_remote_handles();
+
+      if ( m_storage.live_count() == 0 )
+        m_users |= 1;
+
+      m_consuming.store( false, std::memory_order_release );
+    }
+}
+
+wfl_inline void wfl::detail::function_allocator::leave()
+{
+  if ( m_users.fetch_sub( 2 ) == 3 )
+    delete this;
+}
+
+// The pointer is constant-initialized thus reading it needs no guard, such
+// that the function can be inlined down to a load of the thread's storage.
+wfl_inline wfl::detail::function_allocator&
+wfl::detail::thread_local_function_allocator::instance()
+{
+  thread_local function_allocator* allocator( nullptr );
+
+  if ( allocator == nullptr )
+    allocator = &create_instance();
+
+  return *allocator;
+}
+
+wfl_inline wfl::detail::function_allocator&
+wfl::detail::thread_local_function_allocator::create_instance()
+{
+  thread_local const thread_allocator result;
+  return *result.allocator;
+}
@@ -0,0 +1,547 @@
+#pragma once
+
+#include "wfl/detail/function_allocator_storage.hpp"
+#include "wfl/detail/debug.hpp"
+
+#include <algorithm>
+#include <new>
+
+template< std::size_t Size >
+std::atomic
+<
+  typename wfl::detail::function_allocator_storage< Size >::page_entry*
+>
+wfl::detail::function_allocator_storage< Size >::s_chunks[ max_chunk_count ];
+
+template< std::size_t Size >
+std::mutex wfl::detail::function_allocator_storage< Size >::s_mutex;
+
+template< std::size_t Size >
+std::uint32_t wfl::detail::function_allocator_storage< Size >::s_page_count;
+
+template< std::size_t Size >
+std::uint32_t wfl::detail::function_allocator_storage< Size >::s_free_page;
+
+template< std::size_t Size >
+wfl::detail::function_allocator_storage< Size >::function_allocator_storage()
+  : m_resource( get_default_resource() ),
+    m_owner( nullptr ),
+    m_pages( resource_allocator< std::uint32_t >( m_resource ) ),
+    m_next_id( 0 ),
+    m_end_id( 0 ),
+    m_available( resource_allocator< std::size_t >( m_resource ) ),
+    m_deferred_destruction( false ),
+    m_retired( resource_allocator< std::size_t >( m_resource ) )
+{
+
+}
+
+template< std::size_t Size >
+wfl::detail::function_allocator_storage< Size >::~function_allocator_storage()
+{
+  for ( std::uint32_t page : m_pages )
+    give_back_page( page );
+}
+
+template< std::size_t Size >
+void wfl::detail::function_allocator_storage< Size >::set_owner( void* owner )
+{
+  wfl_debug_assert( m_pages.empty() );
+  m_owner = owner;
+}
+
+template< std::size_t Size >
+void* wfl::detail::function_allocator_storage< Size >::owner
+( const allocation_handle& handle )
+{
+  return get_entry( handle.id >> page_size_log2 )
+    .owner.load( std::memory_order_relaxed );
+}
+
+template< std::size_t Size >
+wfl::detail::remote_release&
+wfl::detail::function_allocator_storage< Size >::remote_node
+( const allocation_handle& handle )
+{
+  return get_entry( handle.id >> page_size_log2 )
+    .remote_nodes.load( std::memory_order_relaxed )
+    [ handle.id & ( page_size - 1 ) ];
+}
+
+template< std::size_t Size >
+typename wfl::detail::function_allocator_storage< Size >::allocation_result
+wfl::detail::function_allocator_storage< Size >::allocate()
+{
+  std::size_t id;
+    
+  if ( m_available.empty() )
+    id = grow();
+  else
+    {
+      id = m_available.back();
+      m_available.pop_back();
+    }
+
+  const page_entry& entry( get_entry( id >> page_size_log2 ) );
+  const std::size_t slot( id & ( page_size - 1 ) );
+  block_state& state( entry.states.load( std::memory_order_relaxed )[ slot ] );
+  
+  ++state.version;
+  state.ref_count = 1;
+  ++m_live_count;
+  ++m_allocation_count;
+  m_peak_live_count = std::max( m_peak_live_count, m_live_count );
+
+  allocation_result result;
+  result.handle.version = state.version;
+  result.handle.id = std::uint32_t( id );
+  result.storage =
+    &entry.blocks.load( std::memory_order_relaxed )[ slot ].storage;
+
+  return result;
+}
+
+template< std::size_t Size >
+void wfl::detail::function_allocator_storage< Size >::cancel
+( const allocation_handle& handle )
+{
+  // The block holds no function, thus it must not be destroyed.
+  block_state& state( get_state( handle.id ) );
+
+  state.ref_count = 0;
+  --m_live_count;
+  ++m_release_count;
+
+  if ( state.version != allocation_handle::last_version )
+    m_available.emplace_back( handle.id );
+}
+
+template< std::size_t Size >
+bool wfl::detail::function_allocator_storage< Size >::release_one
+( const allocation_handle& handle )
+{
+  if ( handle.version == allocation_handle::not_a_version )
+    return true;
+
+  const page_entry* const entry( owned_entry( handle.id ) );
+
+  if ( entry == nullptr )
+    return false;
+
+  const std::size_t slot( handle.id & ( page_size - 1 ) );
+  block_state& state
+    ( entry->states.load( std::memory_order_relaxed )[ slot ] );
+
+  wfl_debug_assert( state.ref_count != 0 );
+  --state.ref_count;
+
+  if ( ( state.ref_count == 0 )
+       && ( entry->blocks.load( std::memory_order_relaxed )[ slot ].pin_count
+            == 0 ) )
+    recycle( handle.id );
+
+  return true;
+}
+
+template< std::size_t Size >
+bool wfl::detail::function_allocator_storage< Size >::add_one
+( const allocation_handle& handle )
+{
+  if ( handle.version == allocation_handle::not_a_version )
+    return true;
+
+  const page_entry* const entry( owned_entry( handle.id ) );
+
+  if ( entry == nullptr )
+    return false;
+
+  ++entry->states.load( std::memory_order_relaxed )
+    [ handle.id & ( page_size - 1 ) ].ref_count;
+
+  return true;
+}
+
+template< std::size_t Size >
+void wfl::detail::function_allocator_storage< Size >::release
+( const allocation_handle& handle, std::uint32_t count )
+{
+  const std::size_t id( handle.id );
+  block_state& state( get_state( id ) );
+
+  wfl_debug_assert( state.ref_count >= count );
+  state.ref_count -= count;
+
+  if ( ( state.ref_count == 0 ) && ( get_block( id ).pin_count == 0 ) )
+    recycle( id );
+}
+
+template< std::size_t Size >
+bool wfl::detail::function_allocator_storage< Size >::is_alive
+( const allocation_handle& handle ) const
+{
+  if ( handle.version == allocation_handle::not_a_version )
+    return false;
+
+  const page_entry* const entry( owned_entry( handle.id ) );
+
+  if ( entry == nullptr )
+    return false;
+
+  const block_state& state
+    ( entry->states.load( std::memory_order_relaxed )
+      [ handle.id & ( page_size - 1 ) ] );
+
+  return ( handle.version == state.version ) && ( state.ref_count != 0 );
+}
+
+template< std::size_t Size >
+const typename
+wfl::detail::function_allocator_storage< Size >::function_storage*
+wfl::detail::function_allocator_storage< Size >::pin
+( const allocation_handle& handle )
+{
+  if ( handle.version == allocation_handle::not_a_version )
+    return nullptr;
+
+  const page_entry* const entry( owned_entry( handle.id ) );
+
+  if ( entry == nullptr )
+    return nullptr;
+
+  const std::size_t slot( handle.id & ( page_size - 1 ) );
+  const block_state& state
+    ( entry->states.load( std::memory_order_relaxed )[ slot ] );
+
+  if ( ( handle.version != state.version ) || ( state.ref_count == 0 ) )
+    return nullptr;
+  
+  block& block( entry->blocks.load( std::memory_order_relaxed )[ slot ] );
+  ++block.pin_count;
+  
+  return &block.storage;
+}
+
+template< std::size_t Size >
+void wfl::detail::function_allocator_storage< Size >::unpin
+( const allocation_handle& handle )
+{
+  const page_entry& entry( get_entry( handle.id >> page_size_log2 ) );
+  const std::size_t slot( handle.id & ( page_size - 1 ) );
+  block& block( entry.blocks.load( std::memory_order_relaxed )[ slot ] );
+
+  wfl_debug_assert( block.pin_count != 0 );
+  --block.pin_count;
+
+  if ( ( block.pin_count == 0 )
+       && ( entry.states.load( std::memory_order_relaxed )[ slot ].ref_count
+            == 0 ) )
+    recycle( handle.id );
+}
+
+template< std::size_t Size >
+std::size_t wfl::detail::function_allocator_storage< Size >::live_count() const
+{
+  return m_live_count;
+}
+
+template< std::size_t Size >
+wfl::detail::allocator_statistics
+wfl::detail::function_allocator_storage< Size >::statistics() const
+{
+  allocator_statistics result;
+
+  result.live_count = m_live_count;
+  result.peak_live_count = m_peak_live_count;
+  result.allocation_count = m_allocation_count;
+  result.release_count = m_release_count;
+  result.available_count = m_available.size();
+  result.page_count = m_pages.size();
+
+  return result;
+}
+
+template< std::size_t Size >
+void wfl::detail::function_allocator_storage< Size >::reserve
+( std::size_t count )
+{
+  const std::size_t block_count
+    ( m_live_count + m_available.size() + m_end_id - m_next_id );
+
+  if ( count <= block_count )
+    return;
+
+  m_available.reserve( m_available.size() + count - block_count );
+
+  // The new blocks are pushed in reverse order such that the allocations
+  // use the lowest ids first.
+  const std::size_t first( m_available.size() );
+
+  while ( m_live_count + m_available.size() < count )
+    m_available.emplace_back( grow() );
+
+  std::reverse( m_available.begin() + first, m_available.end() );
+}
+
+template< std::size_t Size >
+void wfl::detail::function_allocator_storage< Size >::defer_destruction
+( bool enabled )
+{
+  m_deferred_destruction = enabled;
+
+  if ( !enabled )
+    collect();
+}
+
+template< std::size_t Size >
+void wfl::detail::function_allocator_storage< Size >::collect()
+{
+  const resource_allocator< std::size_t > allocator( m_resource );
+  resource_vector< std::size_t > retired( allocator );
+
+  while ( !m_retired.empty() )
+    {
+      retired.swap( m_retired );
+
+      for ( std::size_t id : retired )
+        destroy( id );
+
+      retired.clear();
+    }
+}
+
+template< std::size_t Size >
+void wfl::detail::function_allocator_storage< Size >::trim()
+{
+  // The retired blocks look free but still hold their function.
+  collect();
+
+  const resource_allocator< std::uint32_t > allocator( m_resource );
+  resource_vector< std::uint32_t > free_pages( allocator );
+  std::size_t kept( 0 );
+
+  for ( std::uint32_t page : m_pages )
+    {
+      const std::size_t first( std::size_t( page ) << page_size_log2 );
+      std::size_t id( first );
+
+      while ( ( id != first + page_size ) && ( get_state( id ).ref_count == 0 )
+              && ( get_block( id ).pin_count == 0 ) )
+        ++id;
+
+      if ( id == first + page_size )
+        free_pages.emplace_back( page );
+      else
+        {
+          m_pages[ kept ] = page;
+          ++kept;
+        }
+    }
+
+  if ( free_pages.empty() )
+    return;
+
+  m_pages.resize( kept );
+  std::sort( free_pages.begin(), free_pages.end() );
+
+  const auto is_free
+    ( [ &free_pages ]( std::size_t id ) -> bool
+      {
+        return std::binary_search
+          ( free_pages.begin(), free_pages.end(),
+            std::uint32_t( id >> page_size_log2 ) );
+      } );
+
+  m_available.erase
+    ( std::remove_if( m_available.begin(), m_available.end(), is_free ),
+      m_available.end() );
+
+  if ( ( m_next_id != m_end_id ) && is_free( m_next_id ) )
+    {
+      m_next_id = 0;
+      m_end_id = 0;
+    }
+
+  for ( std::uint32_t page : free_pages )
+    give_back_page( page );
+}
+
+template< std::size_t Size >
+void wfl::detail::function_allocator_storage< Size >::shrink_to_fit()
+{
+  trim();
+
+  m_pages.shrink_to_fit();
+  m_available.shrink_to_fit();
+  m_retired.shrink_to_fit();
+}
+
+template< std::size_t Size >
+const typename wfl::detail::function_allocator_storage< Size >::page_entry*
+wfl::detail::function_allocator_storage< Size >::owned_entry
+( std::size_t id ) const
+{
+  // The states of the pages of other owners may be written concurrently,
+  // thus they must not be read.
+  const page_entry& entry( get_entry( id >> page_size_log2 ) );
+
+  if ( entry.owner.load( std::memory_order_relaxed ) != m_owner )
+    return nullptr;
+
+  return &entry;
+}
+
+template< std::size_t Size >
+typename wfl::detail::function_allocator_storage< Size >::page_entry&
+wfl::detail::function_allocator_storage< Size >::get_entry
+( std::size_t page )
+{
+  return s_chunks[ page >> chunk_size_log2 ].load( std::memory_order_acquire )
+    [ page & ( chunk_size - 1 ) ];
+}
+
+template< std::size_t Size >
+typename wfl::detail::function_allocator_storage< Size >::block_state&
+wfl::detail::function_allocator_storage< Size >::get_state( std::size_t id )
+{
+  return get_entry( id >> page_size_log2 )
+    .states.load( std::memory_order_relaxed )[ id & ( page_size - 1 ) ];
+}
+
+template< std::size_t Size >
+typename wfl::detail::function_allocator_storage< Size >::block&
+wfl::detail::function_allocator_storage< Size >::get_block( std::size_t id )
+{
+  return get_entry( id >> page_size_log2 )
+    .blocks.load( std::memory_order_relaxed )[ id & ( page_size - 1 ) ];
+}
+
+template< std::size_t Size >
+std::size_t wfl::detail::function_allocator_storage< Size >::grow()
+{
+  // The blocks having reached the last version are skipped.
+  std::size_t id;
+
+  do
+    {
+      if ( m_next_id == m_end_id )
+        take_page();
+
+      id = m_next_id;
+      ++m_next_id;
+    }
+  while ( get_state( id ).version == allocation_handle::last_version );
+
+  return id;
+}
+
+template< std::size_t Size >
+void wfl::detail::function_allocator_storage< Size >::take_page()
+{
+  // The slot of the page is reserved before the allocation of the page,
+  // such that the page is not lost if the insertion fails.
+  m_pages.reserve( m_pages.size() + 1 );
+
+  block* const blocks( new_page< block >( *m_resource, page_size ) );
+  remote_release* remote_nodes( nullptr );
+  std::uint32_t page;
+
+  try
+    {
+      remote_nodes = new_page< remote_release >( *m_resource, page_size );
+      page = take_free_page();
+    }
+  catch( ... )
+    {
+      delete_page( remote_nodes, *m_resource, page_size );
+      delete_page( blocks, *m_resource, page_size );
+      throw;
+    }
+
+  page_entry& entry( get_entry( page ) );
+  entry.blocks.store( blocks, std::memory_order_relaxed );
+  entry.remote_nodes.store( remote_nodes, std::memory_order_relaxed );
+  entry.owner.store( m_owner, std::memory_order_relaxed );
+
+  m_pages.push_back( page );
+  m_next_id = std::size_t( page ) << page_size_log2;
+  m_end_id = m_next_id + page_size;
+}
+
+template< std::size_t Size >
+std::uint32_t
+wfl::detail::function_allocator_storage< Size >::take_free_page()
+{
+  const std::lock_guard< std::mutex > lock( s_mutex );
+
+  if ( s_free_page != 0 )
+    {
+      const std::uint32_t result( s_free_page - 1 );
+      s_free_page = get_entry( result ).next_free;
+      return result;
+    }
+
+  const std::uint32_t result( s_page_count );
+
+  if ( result == max_page_count )
+    throw std::bad_alloc();
+
+  std::atomic< page_entry* >& chunk( s_chunks[ result >> chunk_size_log2 ] );
+
+  if ( chunk.load( std::memory_order_relaxed ) == nullptr )
+    chunk.store
+      ( new_page< page_entry >( *new_delete_resource(), chunk_size ),
+        std::memory_order_release );
+
+  get_entry( result ).states.store
+    ( new_page< block_state >( *new_delete_resource(), page_size ),
+      std::memory_order_relaxed );
+  ++s_page_count;
+
+  return result;
+}
+
+template< std::size_t Size >
+void wfl::detail::function_allocator_storage< Size >::give_back_page
+( std::uint32_t page )
+{
+  page_entry& entry( get_entry( page ) );
+
+  delete_page
+    ( entry.blocks.exchange( nullptr, std::memory_order_relaxed ),
+      *m_resource, page_size );
+  delete_page
+    ( entry.remote_nodes.exchange( nullptr, std::memory_order_relaxed ),
+      *m_resource, page_size );
+
+  const std::lock_guard< std::mutex > lock( s_mutex );
+  entry.owner.store( nullptr, std::memory_order_relaxed );
+  entry.next_free = s_free_page;
+  s_free_page = page + 1;
+}
+
+template< std::size_t Size >
+void wfl::detail::function_allocator_storage< Size >::recycle( std::size_t id )
+{
+  if ( m_deferred_destruction )
+    m_retired.emplace_back( id );
+  else
+    destroy( id );
+}
+
+template< std::size_t Size >
+void wfl::detail::function_allocator_storage< Size >::destroy( std::size_t id )
+{
+  // The slot is made available after the destruction of the function since
+  // its destructor may allocate new functions. A block whose version
+  // reached the last value is never used again.
+  const page_entry& entry( get_entry( id >> page_size_log2 ) );
+  const std::size_t slot( id & ( page_size - 1 ) );
+
+  entry.blocks.load( std::memory_order_relaxed )[ slot ].storage.destroy();
+  --m_live_count;
+  ++m_release_count;
+
+  if ( entry.states.load( std::memory_order_relaxed )[ slot ].version
+       != allocation_handle::last_version )
+    m_available.emplace_back( id );
+}
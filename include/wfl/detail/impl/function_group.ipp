@@ -0,0 +1,31 @@
+#pragma once
+
+#include "wfl/detail/function_group.hpp"
+
+wfl_inline wfl::detail::function_group::function_group()
+  : m_group( function_group_storage::not_a_group ),
+    m_size( 0 )
+{
+
+}
+
+wfl_inline wfl::detail::function_group::~function_group()
+{
+  expire();
+}
+
+wfl_inline void wfl::detail::function_group::expire()
+{
+  if ( m_group == function_group_storage::not_a_group )
+    return;
+
+  thread_safe_function_allocator::instance().release_group( m_group );
+
+  m_group = function_group_storage::not_a_group;
+  m_size = 0;
+}
+
+wfl_inline std::size_t wfl::detail::function_group::size() const
+{
+  return m_size;
+}
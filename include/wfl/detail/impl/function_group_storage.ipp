@@ -0,0 +1,310 @@
+#pragma once
+
+#include "wfl/detail/function_group_storage.hpp"
+
+#include "wfl/detail/debug.hpp"
+#include "wfl/detail/page.hpp"
+
+#include <new>
+
+wfl_inline wfl::detail::function_group_storage::function_group_storage()
+  : m_resource( get_default_resource() ),
+    m_group_count( 0 ),
+    m_available( resource_allocator< std::uint32_t >( m_resource ) ),
+    m_deferred_destruction( false ),
+    m_retired_count( 0 ),
+    m_retired( resource_allocator< retired_group >( m_resource ) )
+{
+  for ( std::size_t i( 0 ); i != max_group_page_count; ++i )
+    m_group_pages[ i ].store( nullptr, std::memory_order_relaxed );
+}
+
+wfl_inline wfl::detail::function_group_storage::~function_group_storage()
+{
+  // No reader can be left at this point, thus the functions of the
+  // released groups and of the groups still alive can be destroyed.
+  for ( const retired_group& group : m_retired )
+    destroy( group );
+
+  for ( std::size_t i( 0 ); i != m_group_count; ++i )
+    {
+      const group_record& record( get_record( i ) );
+      retired_group group;
+      group.size = record.size;
+
+      for ( std::size_t p( 0 ); p != block_page_count; ++p )
+        group.pages[ p ] = record.pages[ p ].load( std::memory_order_relaxed );
+
+      destroy( group );
+    }
+
+  for ( std::size_t i( 0 ); i != max_group_page_count; ++i )
+    delete_page
+      ( m_group_pages[ i ].load( std::memory_order_relaxed ), *m_resource,
+        group_page_size );
+}
+
+wfl_inline std::uint32_t wfl::detail::function_group_storage::create()
+{
+  const std::lock_guard< std::mutex > lock( m_mutex );
+
+  if ( !m_available.empty() )
+    {
+      const std::uint32_t result( m_available.back() );
+      m_available.pop_back();
+      return result;
+    }
+
+  const std::size_t page( m_group_count >> group_page_size_log2 );
+
+  if ( page == max_group_page_count )
+    throw std::bad_alloc();
+
+  if ( m_group_pages[ page ].load( std::memory_order_relaxed ) == nullptr )
+    m_group_pages[ page ].store
+      ( new_page< group_record >( *m_resource, group_page_size ),
+        std::memory_order_release );
+
+  const std::uint32_t result( m_group_count );
+  ++m_group_count;
+
+  get_record( result ).generation.store( 1, std::memory_order_relaxed );
+
+  return result;
+}
+
+wfl_inline void
+wfl::detail::function_group_storage::release( std::uint32_t group )
+{
+  group_record& record( get_record( group ) );
+
+  // The new generation expires the handles of the group. The blocks are
+  // retired after it, thus in an epoch not older than the one of a reader
+  // having seen the previous generation.
+  const std::uint32_t generation
+    ( record.generation.load( std::memory_order_relaxed ) + 1 );
+  record.generation.store( generation );
+
+  retired_group retired;
+  retired.epoch = epoch_domain::current();
+  retired.size = record.size;
+
+  for ( std::size_t i( 0 ); i != block_page_count; ++i )
+    retired.pages[ i ] =
+      record.pages[ i ].exchange( nullptr, std::memory_order_relaxed );
+
+  record.size = 0;
+
+  std::unique_lock< std::mutex > lock( m_mutex );
+
+  // A record whose generation reached the last value is never used again.
+  if ( generation != allocation_handle::last_version )
+    m_available.emplace_back( group );
+
+  if ( retired.pages[ 0 ] == nullptr )
+    return;
+
+  m_retired.emplace_back( retired );
+  m_retired_count.fetch_add( 1, std::memory_order_relaxed );
+
+  if ( !m_deferred_destruction.load( std::memory_order_relaxed ) )
+    reclaim( lock );
+}
+
+wfl_inline bool wfl::detail::function_group_storage::is_alive
+( const allocation_handle& handle ) const
+{
+  if ( handle.version == allocation_handle::not_a_version )
+    return false;
+
+  return get_record( handle.id >> block_id_bits )
+    .generation.load( std::memory_order_acquire )
+    == handle.version;
+}
+
+wfl_inline const wfl::detail::function_group_storage::function_storage*
+wfl::detail::function_group_storage::pin( const allocation_handle& handle )
+{
+  if ( handle.version == allocation_handle::not_a_version )
+    return nullptr;
+
+  epoch_domain::enter();
+
+  const function_storage* const result( lookup( handle ) );
+
+  if ( result == nullptr )
+    unpin( handle );
+
+  return result;
+}
+
+wfl_inline const wfl::detail::function_group_storage::function_storage*
+wfl::detail::function_group_storage::lookup
+( const allocation_handle& handle ) const
+{
+  if ( handle.version == allocation_handle::not_a_version )
+    return nullptr;
+
+  const group_record& record( get_record( handle.id >> block_id_bits ) );
+
+  if ( record.generation.load() != handle.version )
+    return nullptr;
+
+  const std::size_t block( handle.id & ( max_group_size - 1 ) );
+  const function_storage* const page
+    ( record.pages[ block >> block_page_size_log2 ]
+      .load( std::memory_order_acquire ) );
+
+  // The group may have been released and its record reused between the
+  // two checks, in which case the page belongs to another group.
+  if ( ( page == nullptr ) || ( record.generation.load() != handle.version ) )
+    return nullptr;
+
+  return page + ( block & ( block_page_size - 1 ) );
+}
+
+wfl_inline void
+wfl::detail::function_group_storage::unpin( const allocation_handle& )
+{
+  if ( epoch_domain::leave() )
+    try_reclaim();
+}
+
+wfl_inline void wfl::detail::function_group_storage::try_reclaim()
+{
+  if ( ( m_retired_count.load( std::memory_order_relaxed ) == 0 )
+       || m_deferred_destruction.load( std::memory_order_relaxed ) )
+    return;
+
+  std::unique_lock< std::mutex > lock( m_mutex, std::try_to_lock );
+
+  if ( lock.owns_lock() )
+    reclaim( lock );
+}
+
+wfl_inline void
+wfl::detail::function_group_storage::defer_destruction( bool enabled )
+{
+  m_deferred_destruction.store( enabled, std::memory_order_relaxed );
+
+  if ( !enabled )
+    collect();
+}
+
+wfl_inline void wfl::detail::function_group_storage::collect()
+{
+  if ( m_retired_count.load( std::memory_order_relaxed ) == 0 )
+    return;
+
+  std::unique_lock< std::mutex > lock( m_mutex );
+  reclaim( lock );
+}
+
+wfl_inline void wfl::detail::function_group_storage::trim()
+{
+  // The pages of blocks of a group are released with its functions.
+  collect();
+}
+
+wfl_inline void wfl::detail::function_group_storage::shrink_to_fit()
+{
+  trim();
+
+  const std::lock_guard< std::mutex > lock( m_mutex );
+  m_available.shrink_to_fit();
+  m_retired.shrink_to_fit();
+}
+
+wfl_inline wfl::detail::function_group_storage::group_record&
+wfl::detail::function_group_storage::get_record( std::uint32_t group ) const
+{
+  group_record* const page
+    ( m_group_pages[ group >> group_page_size_log2 ]
+      .load( std::memory_order_acquire ) );
+
+  wfl_debug_assert( page != nullptr );
+
+  return page[ group & ( group_page_size - 1 ) ];
+}
+
+wfl_inline wfl::detail::function_group_storage::function_storage&
+wfl::detail::function_group_storage::next_block( std::uint32_t group )
+{
+  group_record& record( get_record( group ) );
+
+  if ( record.size == max_group_size )
+    throw std::bad_alloc();
+
+  std::atomic< function_storage* >& page
+    ( record.pages[ record.size >> block_page_size_log2 ] );
+
+  if ( page.load( std::memory_order_relaxed ) == nullptr )
+    {
+      // The resource is shared with the other groups.
+      const std::lock_guard< std::mutex > lock( m_mutex );
+      page.store
+        ( new_page< function_storage >( *m_resource, block_page_size ),
+          std::memory_order_release );
+    }
+
+  return page.load( std::memory_order_relaxed )
+    [ record.size & ( block_page_size - 1 ) ];
+}
+
+wfl_inline wfl::detail::function_group_storage::allocation_handle
+wfl::detail::function_group_storage::commit( std::uint32_t group )
+{
+  group_record& record( get_record( group ) );
+
+  allocation_handle result;
+  result.version = record.generation.load( std::memory_order_relaxed );
+  result.id = ( group << block_id_bits ) | std::uint32_t( record.size );
+
+  ++record.size;
+
+  return result;
+}
+
+wfl_inline void
+wfl::detail::function_group_storage::destroy( const retired_group& group )
+{
+  for ( std::size_t i( 0 ); i != group.size; ++i )
+    group.pages[ i >> block_page_size_log2 ]
+      [ i & ( block_page_size - 1 ) ].destroy();
+
+  for ( function_storage* page : group.pages )
+    delete_page( page, *m_resource, block_page_size );
+}
+
+wfl_inline void wfl::detail::function_group_storage::reclaim
+( std::unique_lock< std::mutex >& lock )
+{
+  const epoch_domain::epoch_type oldest_reader
+    ( epoch_domain::synchronize() );
+  resource_vector< retired_group > reclaimable
+    ( ( resource_allocator< retired_group >( m_resource ) ) );
+  std::size_t kept( 0 );
+
+  for ( const retired_group& group : m_retired )
+    if ( group.epoch < oldest_reader )
+      reclaimable.emplace_back( group );
+    else
+      {
+        m_retired[ kept ] = group;
+        ++kept;
+      }
+
+  if ( reclaimable.empty() )
+    return;
+
+  m_retired.resize( kept );
+  m_retired_count.fetch_sub
+    ( reclaimable.size(), std::memory_order_relaxed );
+
+  // The functions are destroyed outside the lock since their destructor may
+  // create or release other groups.
+  lock.unlock();
+
+  for ( const retired_group& group : reclaimable )
+    destroy( group );
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "wfl/detail/mpsc_queue.hpp"
+
+// This is Dmitry Vyukov's intrusive MPSC queue. The producers only exchange
+// the head, thus a push completes in a bounded number of steps.
+
+wfl_inline wfl::detail::mpsc_queue::mpsc_queue()
+  : m_head( &m_stub ),
+    m_tail( &m_stub )
+{
+  m_stub.next.store( nullptr, std::memory_order_relaxed );
+}
+
+wfl_inline void wfl::detail::mpsc_queue::push( mpsc_node& node )
+{
+  node.next.store( nullptr, std::memory_order_relaxed );
+
+  mpsc_node* const previous
+    ( m_head.exchange( &node, std::memory_order_acq_rel ) );
+  previous->next.store( &node, std::memory_order_release );
+}
+
+wfl_inline wfl::detail::mpsc_node* wfl::detail::mpsc_queue::pop()
+{
+  mpsc_node* tail( m_tail );
+  mpsc_node* next( tail->next.load( std::memory_order_acquire ) );
+
+  if ( tail == &m_stub )
+    {
+      if ( next == nullptr )
+        return nullptr;
+
+      m_tail = next;
+      tail = next;
+      next = next->next.load( std::memory_order_acquire );
+    }
+
+  if ( next != nullptr )
+    {
+      m_tail = next;
+      return tail;
+    }
+
+  if ( tail != m_head.load( std::memory_order_acquire ) )
+    return nullptr;
+
+  push( m_stub );
+  next = tail->next.load( std::memory_order_acquire );
+
+  if ( next == nullptr )
+    return nullptr;
+
+  m_tail = next;
+  return tail;
+}
@@ -0,0 +1,496 @@
+#pragma once
+
+#include "wfl/detail/mt_function_allocator_storage.hpp"
+
+#include "wfl/detail/debug.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <new>
+
+namespace wfl
+{
+  namespace detail
+  {
+    constexpr std::uint64_t mt_storage_count_mask = 0xffffffff;
+
+    inline std::uint32_t mt_storage_version( std::uint64_t state )
+    {
+      return state >> 32;
+    }
+
+    inline std::uint32_t mt_storage_count( std::uint64_t state )
+    {
+      return state & mt_storage_count_mask;
+    }
+  }
+}
+
+template< std::size_t Size >
+wfl::detail::mt_function_allocator_storage< Size >::
+mt_function_allocator_storage()
+  : m_resource( get_default_resource() ),
+    m_block_count( 0 ),
+    m_available( resource_allocator< std::size_t >( m_resource ) ),
+    m_deferred_destruction( false ),
+    m_peak_live_count( 0 ),
+    m_allocation_count( 0 ),
+    m_release_count( 0 ),
+    m_contention_count( 0 ),
+    m_lock_wait_time( 0 ),
+    m_retired_count( 0 ),
+    m_retired( resource_allocator< retired_node* >( m_resource ) )
+{
+  for ( std::size_t i( 0 ); i != max_page_count; ++i )
+    {
+      m_state_pages[ i ].store( nullptr, std::memory_order_relaxed );
+      m_pages[ i ].store( nullptr, std::memory_order_relaxed );
+    }
+}
+
+template< std::size_t Size >
+wfl::detail::mt_function_allocator_storage< Size >::
+~mt_function_allocator_storage()
+{
+  // No reader can be left at this point, thus all the retired blocks can be
+  // destroyed.
+  for ( mpsc_node* node( m_retired_queue.pop() ); node != nullptr;
+        node = m_retired_queue.pop() )
+    m_retired.push_back( static_cast< retired_node* >( node ) );
+
+  for ( retired_node* node : m_retired )
+    get_block( node->id ).storage.destroy();
+
+  for ( std::size_t i( 0 ); i != max_page_count; ++i )
+    {
+      delete_page
+        ( m_state_pages[ i ].load( std::memory_order_relaxed ), *m_resource,
+          page_size );
+      delete_page
+        ( m_pages[ i ].load( std::memory_order_relaxed ), *m_resource,
+          page_size );
+    }
+}
+
+template< std::size_t Size >
+typename wfl::detail::mt_function_allocator_storage< Size >::allocation_result
+wfl::detail::mt_function_allocator_storage< Size >::allocate()
+{
+  std::size_t id;
+
+  {
+    std::unique_lock< std::mutex > lock( m_mutex, std::defer_lock );
+    acquire( lock );
+
+    if ( ( m_retired_count.load( std::memory_order_relaxed ) != 0 )
+         && !m_deferred_destruction.load( std::memory_order_relaxed ) )
+      reclaim( lock );
+
+    if ( m_available.empty() )
+      id = grow();
+    else
+      {
+        id = m_available.back();
+        m_available.pop_back();
+      }
+
+    ++m_allocation_count;
+    m_peak_live_count =
+      std::max
+      ( m_peak_live_count,
+        std::size_t( m_allocation_count - m_release_count ) );
+  }
+
+  block_state& state( get_state( id ) );
+
+  const std::uint32_t version
+    ( mt_storage_version( state.load( std::memory_order_relaxed ) ) + 1 );
+
+  state.store
+    ( ( std::uint64_t( version ) << 32 ) | 1, std::memory_order_release );
+
+  allocation_result result;
+  result.handle.version = version;
+  result.handle.id = std::uint32_t( id );
+  result.storage = &get_block( id ).storage;
+
+  return result;
+}
+
+template< std::size_t Size >
+void wfl::detail::mt_function_allocator_storage< Size >::cancel
+( const allocation_handle& handle )
+{
+  // The handle was never handed out, so the block can be given back
+  // without retiring it. It holds no function to destroy.
+  get_state( handle.id ).store
+    ( std::uint64_t( handle.version ) << 32, std::memory_order_release );
+
+  std::unique_lock< std::mutex > lock( m_mutex, std::defer_lock );
+  acquire( lock );
+  ++m_release_count;
+
+  if ( handle.version != allocation_handle::last_version )
+    m_available.emplace_back( handle.id );
+}
+
+template< std::size_t Size >
+bool wfl::detail::mt_function_allocator_storage< Size >::is_alive
+( const allocation_handle& handle ) const
+{
+  if ( handle.version == allocation_handle::not_a_version )
+    return false;
+
+  const state_type state
+    ( get_state( handle.id ).load( std::memory_order_acquire ) );
+
+  return ( mt_storage_version( state ) == handle.version )
+    && ( mt_storage_count( state ) != 0 );
+}
+
+template< std::size_t Size >
+const typename
+wfl::detail::mt_function_allocator_storage< Size >::function_storage*
+wfl::detail::mt_function_allocator_storage< Size >::pin
+( const allocation_handle& handle )
+{
+  if ( handle.version == allocation_handle::not_a_version )
+    return nullptr;
+
+  // The reader is announced before checking the state, thus a concurrent
+  // release either happens before the check, and the check fails, or it
+  // happens after and the block is retired in an epoch not older than the
+  // one of the reader.
+  epoch_domain::enter();
+
+  const function_storage* const result( lookup( handle ) );
+
+  if ( result == nullptr )
+    unpin( handle );
+
+  return result;
+}
+
+template< std::size_t Size >
+const typename
+wfl::detail::mt_function_allocator_storage< Size >::function_storage*
+wfl::detail::mt_function_allocator_storage< Size >::lookup
+( const allocation_handle& handle )
+{
+  if ( handle.version == allocation_handle::not_a_version )
+    return nullptr;
+
+  const state_type state( get_state( handle.id ).load() );
+
+  if ( ( mt_storage_version( state ) != handle.version )
+       || ( mt_storage_count( state ) == 0 ) )
+    return nullptr;
+
+  return &get_block( handle.id ).storage;
+}
+
+template< std::size_t Size >
+void wfl::detail::mt_function_allocator_storage< Size >::unpin
+( const allocation_handle& )
+{
+  // The blocks released during the call are reclaimed as soon as possible,
+  // such that the resources held by the functions do not outlive their
+  // last caller.
+  if ( epoch_domain::leave() )
+    try_reclaim();
+}
+
+template< std::size_t Size >
+void wfl::detail::mt_function_allocator_storage< Size >::release_one
+( const allocation_handle& handle )
+{
+  if ( handle.version == allocation_handle::not_a_version )
+    return;
+
+  const state_type state( get_state( handle.id ).fetch_sub( 1 ) );
+
+  wfl_debug_assert( mt_storage_count( state ) != 0 );
+
+  if ( mt_storage_count( state ) != 1 )
+    return;
+
+  block& block( get_block( handle.id ) );
+
+  block.retired.epoch = epoch_domain::current();
+  block.retired.id = handle.id;
+
+  m_retired_count.fetch_add( 1, std::memory_order_relaxed );
+  m_retired_queue.push( block.retired );
+
+  // Without a concurrent reader the function is destroyed right away,
+  // otherwise the reader reclaims it when it unpins the block.
+  try_reclaim();
+}
+
+template< std::size_t Size >
+void wfl::detail::mt_function_allocator_storage< Size >::add_one
+( const allocation_handle& handle )
+{
+  if ( handle.version == allocation_handle::not_a_version )
+    return;
+
+  get_state( handle.id ).fetch_add( 1, std::memory_order_relaxed );
+}
+
+template< std::size_t Size >
+typename wfl::detail::mt_function_allocator_storage< Size >::block_state&
+wfl::detail::mt_function_allocator_storage< Size >::get_state
+( std::size_t id ) const
+{
+  block_state* const page
+    ( m_state_pages[ id >> page_size_log2 ]
+      .load( std::memory_order_acquire ) );
+
+  wfl_debug_assert( page != nullptr );
+
+  return page[ id & ( page_size - 1 ) ];
+}
+
+template< std::size_t Size >
+typename wfl::detail::mt_function_allocator_storage< Size >::block&
+wfl::detail::mt_function_allocator_storage< Size >::get_block
+( std::size_t id ) const
+{
+  block* const page
+    ( m_pages[ id >> page_size_log2 ].load( std::memory_order_acquire ) );
+
+  wfl_debug_assert( page != nullptr );
+
+  return page[ id & ( page_size - 1 ) ];
+}
+
+template< std::size_t Size >
+void wfl::detail::mt_function_allocator_storage< Size >::try_reclaim()
+{
+  if ( ( m_retired_count.load( std::memory_order_relaxed ) == 0 )
+       || m_deferred_destruction.load( std::memory_order_relaxed ) )
+    return;
+
+  std::unique_lock< std::mutex > lock( m_mutex, std::try_to_lock );
+
+  if ( lock.owns_lock() )
+    reclaim( lock );
+}
+
+template< std::size_t Size >
+void wfl::detail::mt_function_allocator_storage< Size >::defer_destruction
+( bool enabled )
+{
+  m_deferred_destruction.store( enabled, std::memory_order_relaxed );
+
+  if ( !enabled )
+    collect();
+}
+
+template< std::size_t Size >
+void wfl::detail::mt_function_allocator_storage< Size >::collect()
+{
+  if ( m_retired_count.load( std::memory_order_relaxed ) == 0 )
+    return;
+
+  std::unique_lock< std::mutex > lock( m_mutex, std::defer_lock );
+  acquire( lock );
+  reclaim( lock );
+}
+
+template< std::size_t Size >
+wfl::detail::allocator_statistics
+wfl::detail::mt_function_allocator_storage< Size >::statistics()
+{
+  const std::lock_guard< std::mutex > lock( m_mutex );
+  allocator_statistics result;
+
+  result.live_count = m_allocation_count - m_release_count;
+  result.peak_live_count = m_peak_live_count;
+  result.allocation_count = m_allocation_count;
+  result.release_count = m_release_count;
+  result.available_count = m_available.size();
+  result.page_count = ( m_block_count + page_size - 1 ) >> page_size_log2;
+  result.contention_count = m_contention_count;
+  result.lock_wait_time = m_lock_wait_time;
+
+  return result;
+}
+
+template< std::size_t Size >
+void wfl::detail::mt_function_allocator_storage< Size >::reserve
+( std::size_t count )
+{
+  const std::lock_guard< std::mutex > lock( m_mutex );
+
+  if ( count <= m_block_count )
+    return;
+
+  m_available.reserve( m_available.size() + count - m_block_count );
+
+  // The new blocks are pushed in reverse order such that the allocations
+  // use the lowest ids first.
+  const std::size_t first( m_available.size() );
+
+  while ( m_block_count < count )
+    m_available.emplace_back( grow() );
+
+  std::reverse( m_available.begin() + first, m_available.end() );
+}
+
+template< std::size_t Size >
+void wfl::detail::mt_function_allocator_storage< Size >::trim()
+{
+  std::unique_lock< std::mutex > lock( m_mutex );
+  trim( lock );
+}
+
+template< std::size_t Size >
+void wfl::detail::mt_function_allocator_storage< Size >::shrink_to_fit()
+{
+  std::unique_lock< std::mutex > lock( m_mutex );
+  trim( lock );
+
+  m_available.shrink_to_fit();
+  m_retired.shrink_to_fit();
+}
+
+template< std::size_t Size >
+std::size_t wfl::detail::mt_function_allocator_storage< Size >::grow()
+{
+  // The pages of the states are never freed, thus the versions of the
+  // blocks released by trim() continue from their last value. The blocks
+  // having reached the last version are skipped.
+  std::size_t id;
+
+  do
+    {
+      id = m_block_count;
+      const std::size_t page( id >> page_size_log2 );
+
+      if ( page == max_page_count )
+        throw std::bad_alloc();
+
+      if ( m_state_pages[ page ].load( std::memory_order_relaxed )
+           == nullptr )
+        m_state_pages[ page ].store
+          ( new_page< block_state >( *m_resource, page_size ),
+            std::memory_order_release );
+
+      if ( m_pages[ page ].load( std::memory_order_relaxed ) == nullptr )
+        m_pages[ page ].store
+          ( new_page< block >( *m_resource, page_size ),
+            std::memory_order_release );
+
+      ++m_block_count;
+    }
+  while ( mt_storage_version
+          ( get_state( id ).load( std::memory_order_relaxed ) )
+          == allocation_handle::last_version );
+
+  return id;
+}
+
+template< std::size_t Size >
+void wfl::detail::mt_function_allocator_storage< Size >::acquire
+( std::unique_lock< std::mutex >& lock )
+{
+  // The clock is read only when the lock is contended.
+  if ( lock.try_lock() )
+    return;
+
+  const std::chrono::steady_clock::time_point start
+    ( std::chrono::steady_clock::now() );
+
+  lock.lock();
+
+  ++m_contention_count;
+  m_lock_wait_time +=
+    std::chrono::duration_cast< std::chrono::nanoseconds >
+    ( std::chrono::steady_clock::now() - start );
+}
+
+template< std::size_t Size >
+void wfl::detail::mt_function_allocator_storage< Size >::trim
+( std::unique_lock< std::mutex >& lock )
+{
+  if ( m_retired_count.load( std::memory_order_relaxed ) != 0 )
+    reclaim( lock );
+
+  // Only the available blocks are free: the retired ones may still be
+  // observed by a reader. Sorting the ids in decreasing order gives the
+  // free blocks at the end of the storage, and keeps the allocations in
+  // the lowest ids.
+  std::sort
+    ( m_available.begin(), m_available.end(),
+      std::greater< std::size_t >() );
+
+  std::size_t free_count( 0 );
+
+  while ( ( free_count != m_available.size() )
+          && ( m_available[ free_count ] == m_block_count - free_count - 1 ) )
+    ++free_count;
+
+  if ( free_count == 0 )
+    return;
+
+  m_available.erase
+    ( m_available.begin(), m_available.begin() + free_count );
+  m_block_count -= free_count;
+
+  const std::size_t first_free_page
+    ( ( m_block_count + page_size - 1 ) >> page_size_log2 );
+
+  for ( std::size_t page( first_free_page ); page != max_page_count; ++page )
+    delete_page
+      ( m_pages[ page ].exchange( nullptr, std::memory_order_relaxed ),
+        *m_resource, page_size );
+}
+
+template< std::size_t Size >
+void wfl::detail::mt_function_allocator_storage< Size >::reclaim
+( std::unique_lock< std::mutex >& lock )
+{
+  for ( mpsc_node* node( m_retired_queue.pop() ); node != nullptr;
+        node = m_retired_queue.pop() )
+    m_retired.push_back( static_cast< retired_node* >( node ) );
+
+  const epoch_domain::epoch_type oldest_reader
+    ( epoch_domain::synchronize() );
+  resource_vector< retired_node* > reclaimable
+    ( ( resource_allocator< retired_node* >( m_resource ) ) );
+  std::size_t kept( 0 );
+
+  for ( retired_node* node : m_retired )
+    if ( node->epoch < oldest_reader )
+      reclaimable.push_back( node );
+    else
+      {
+        m_retired[ kept ] = node;
+        ++kept;
+      }
+
+  if ( reclaimable.empty() )
+    return;
+
+  m_retired.resize( kept );
+  m_retired_count.fetch_sub
+    ( reclaimable.size(), std::memory_order_relaxed );
+
+  // The functions are destroyed outside the lock since their destructor may
+  // allocate other functions.
+  lock.unlock();
+
+  for ( const retired_node* node : reclaimable )
+    get_block( node->id ).storage.destroy();
+
+  acquire( lock );
+  m_release_count += reclaimable.size();
+
+  // A block whose version reached the last value is never used again.
+  for ( const retired_node* node : reclaimable )
+    if ( mt_storage_version
+         ( get_state( node->id ).load( std::memory_order_relaxed ) )
+         != allocation_handle::last_version )
+      m_available.emplace_back( node->id );
+}
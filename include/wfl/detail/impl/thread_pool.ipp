@@ -0,0 +1,189 @@
+#pragma once
+
+#include "wfl/detail/thread_pool.hpp"
+
+#include "wfl/detail/debug.hpp"
+
+namespace wfl
+{
+  namespace detail
+  {
+    // The pool and the index of the worker running in the current thread,
+    // such that the tasks submitted by a worker go in its own queue.
+    struct thread_pool_worker
+    {
+      const thread_pool* pool;
+      std::size_t index;
+    };
+
+    wfl_inline thread_pool_worker& this_thread_pool_worker()
+    {
+      thread_local thread_pool_worker result = { nullptr, 0 };
+      return result;
+    }
+  }
+}
+
+wfl_inline
+wfl::detail::thread_pool::thread_pool( std::size_t worker_count )
+  : m_pending_count( 0 ),
+    m_next_queue( 0 ),
+    m_run_count( 0 ),
+    m_dropped_count( 0 ),
+    m_sleeping_count( 0 ),
+    m_stop( false )
+{
+  wfl_debug_assert( worker_count != 0 );
+
+  m_queues.reserve( worker_count );
+
+  for ( std::size_t i( 0 ); i != worker_count; ++i )
+    m_queues.emplace_back( aligned_new< worker_queue >() );
+
+  m_workers.reserve( worker_count );
+
+  for ( std::size_t i( 0 ); i != worker_count; ++i )
+    m_workers.emplace_back( &thread_pool::run, this, i );
+}
+
+wfl_inline wfl::detail::thread_pool::~thread_pool()
+{
+  {
+    const std::lock_guard< std::mutex > lock( m_mutex );
+    m_stop = true;
+  }
+
+  m_condition.notify_all();
+
+  for ( std::thread& worker : m_workers )
+    worker.join();
+}
+
+wfl_inline void wfl::detail::thread_pool::submit( const task_type& task )
+{
+  const thread_pool_worker& current( this_thread_pool_worker() );
+  const std::size_t queue
+    ( ( current.pool == this )
+      ? current.index
+      : ( m_next_queue.fetch_add( 1, std::memory_order_relaxed )
+          % m_queues.size() ) );
+
+  ++m_pending_count;
+
+  {
+    worker_queue& q( *m_queues[ queue ] );
+    const std::lock_guard< std::mutex > lock( q.mutex );
+    q.tasks.push_back( task );
+  }
+
+  // A worker about to sleep increments m_sleeping_count before checking
+  // m_pending_count, thus either it sees the task or it is seen here. The
+  // lock then orders the notification after its wait.
+  if ( m_sleeping_count.load() == 0 )
+    return;
+
+  {
+    const std::lock_guard< std::mutex > lock( m_mutex );
+  }
+
+  m_condition.notify_one();
+}
+
+wfl_inline std::uint64_t wfl::detail::thread_pool::run_count() const
+{
+  return m_run_count.load( std::memory_order_relaxed );
+}
+
+wfl_inline std::uint64_t wfl::detail::thread_pool::dropped_count() const
+{
+  return m_dropped_count.load( std::memory_order_relaxed );
+}
+
+wfl_inline void wfl::detail::thread_pool::run( std::size_t worker )
+{
+  thread_pool_worker& current( this_thread_pool_worker() );
+  current.pool = this;
+  current.index = worker;
+
+  task_type task;
+
+  while ( true )
+    {
+      if ( pop( worker, task ) || steal( worker, task ) )
+        {
+          --m_pending_count;
+
+          // The expiration is checked again by the call, thus a task
+          // expiring after this check is not run either.
+          if ( task.expired() )
+            m_dropped_count.fetch_add( 1, std::memory_order_relaxed );
+          else
+            {
+              task();
+              m_run_count.fetch_add( 1, std::memory_order_relaxed );
+            }
+
+          continue;
+        }
+
+      std::unique_lock< std::mutex > lock( m_mutex );
+      ++m_sleeping_count;
+
+      if ( m_pending_count.load() == 0 )
+        {
+          if ( m_stop )
+            {
+              --m_sleeping_count;
+              break;
+            }
+
+          m_condition.wait
+            ( lock,
+              [ this ]() -> bool
+              {
+                return m_stop || ( m_pending_count.load() != 0 );
+              } );
+        }
+
+      --m_sleeping_count;
+    }
+
+  current.pool = nullptr;
+}
+
+wfl_inline bool
+wfl::detail::thread_pool::pop( std::size_t worker, task_type& task )
+{
+  worker_queue& q( *m_queues[ worker ] );
+  const std::lock_guard< std::mutex > lock( q.mutex );
+
+  if ( q.tasks.empty() )
+    return false;
+
+  task = q.tasks.back();
+  q.tasks.pop_back();
+
+  return true;
+}
+
+wfl_inline bool
+wfl::detail::thread_pool::steal( std::size_t worker, task_type& task )
+{
+  const std::size_t count( m_queues.size() );
+
+  for ( std::size_t i( 1 ); i != count; ++i )
+    {
+      worker_queue& q( *m_queues[ ( worker + i ) % count ] );
+      const std::lock_guard< std::mutex > lock( q.mutex );
+
+      if ( q.tasks.empty() )
+        continue;
+
+      task = q.tasks.front();
+      q.tasks.pop_front();
+
+      return true;
+    }
+
+  return false;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "wfl/detail/thread_safe_function_allocator.hpp"
+
+#include "wfl/detail/aligned_allocation.hpp"
+
+#include <atomic>
+
+namespace wfl
+{
+  namespace detail
+  {
+    class call_counters_owner
+    {
+    public:
+      call_counters_owner();
+      ~call_counters_owner();
+
+      call_counters& counters;
+
+    private:
+      static call_counters& acquire();
+    };
+
+    wfl_inline std::atomic< call_counters* >& call_counters_list()
+    {
+      static std::atomic< call_counters* > result( nullptr );
+      return result;
+    }
+  }
+}
+
+wfl_inline wfl::detail::call_counters_owner::call_counters_owner()
+  : counters( acquire() )
+{
+
+}
+
+wfl_inline wfl::detail::call_counters_owner::~call_counters_owner()
+{
+  counters.in_use.store( false, std::memory_order_release );
+}
+
+wfl_inline wfl::detail::call_counters&
+wfl::detail::call_counters_owner::acquire()
+{
+  for ( call_counters* c
+          ( call_counters_list().load( std::memory_order_acquire ) );
+        c != nullptr; c = c->next )
+    {
+      bool expected( false );
+
+      if ( c->in_use.compare_exchange_strong( expected, true ) )
+        return *c;
+    }
+
+  call_counters* const result( aligned_new< call_counters >() );
+  result->call_count.store( 0, std::memory_order_relaxed );
+  result->expired_call_count.store( 0, std::memory_order_relaxed );
+  result->in_use.store( true, std::memory_order_relaxed );
+  result->next = call_counters_list().load( std::memory_order_relaxed );
+
+  while ( !call_counters_list().compare_exchange_weak
+          ( result->next, result, std::memory_order_release,
+            std::memory_order_relaxed ) );
+
+  return *result;
+}
+
+// The allocator is created on its first use, thus it outlives the static
+// objects whose construction allocated a function.
+wfl_inline wfl::detail::mt_function_allocator&
+wfl::detail::thread_safe_function_allocator::instance()
+{
+  static mt_function_allocator result;
+  return result;
+}
+
+wfl_inline std::size_t wfl::detail::mt_function_allocator::current_shard()
+{
+  // The shards are assigned to the threads in a round-robin fashion.
+  static std::atomic< std::size_t > next_shard( 0 );
+  thread_local const std::size_t result
+    ( next_shard.fetch_add( 1, std::memory_order_relaxed ) % shard_count );
+
+  return result;
+}
+
+wfl_inline wfl::detail::call_counters&
+wfl::detail::mt_function_allocator::this_thread_call_counters()
+{
+  thread_local const call_counters_owner owner;
+  return owner.counters;
+}
+
+wfl_inline const wfl::detail::call_counters*
+wfl::detail::mt_function_allocator::all_call_counters()
+{
+  return call_counters_list().load( std::memory_order_acquire );
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "wfl/detail/config.hpp"
+
+#include <atomic>
+
+namespace wfl
+{
+  namespace detail
+  {
+    struct mpsc_node
+    {
+      std::atomic< mpsc_node* > next;
+    };
+
+    // An intrusive queue where any thread can push a node without waiting,
+    // while a single consumer at a time pops them. The nodes are owned by
+    // the caller and must stay alive until they are popped.
+    class mpsc_queue
+    {
+    public:
+      mpsc_queue();
+
+      mpsc_queue( const mpsc_queue& ) = delete;
+      mpsc_queue& operator=( const mpsc_queue& ) = delete;
+
+      void push( mpsc_node& node );
+
+      // Returns nullptr if the queue is empty, or if a producer is in the
+      // middle of a push. In the latter case the node will be available in
+      // a later call.
+      mpsc_node* pop();
+
+    private:
+      mpsc_node m_stub;
+      std::atomic< mpsc_node* > m_head;
+      mpsc_node* m_tail;
+    };
+  }
+}
+
+#ifdef WFL_HEADER_ONLY
+  #include "wfl/detail/impl/mpsc_queue.ipp"
+#endif
@@ -0,0 +1,191 @@
+#pragma once
+
+#include "wfl/detail/allocation_handle.hpp"
+#include "wfl/detail/allocator_statistics.hpp"
+#include "wfl/detail/callable_storage.hpp"
+#include "wfl/detail/config.hpp"
+#include "wfl/detail/epoch_domain.hpp"
+#include "wfl/detail/mpsc_queue.hpp"
+#include "wfl/detail/page.hpp"
+#include "wfl/detail/resource_allocator.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace wfl
+{
+  namespace detail
+  {
+    // Thread-safe storage for the functions, where the validity check of a
+    // handle and the access to its function do not need any lock. The
+    // blocks whose last reference is released are retired and reclaimed
+    // once no reader can observe them anymore, thus releasing a function
+    // never waits. Only the allocation of a block and the reclamation of
+    // the retired blocks are serialized.
+    template< std::size_t Size >
+    class mt_function_allocator_storage
+    {
+    public:
+      typedef detail::allocation_handle allocation_handle;
+      typedef sized_callable_storage< Size > function_storage;
+
+      struct allocation_result
+      {
+        allocation_handle handle;
+        function_storage* storage;
+      };
+
+    public:
+      // The memory of the blocks and of the containers comes from the
+      // default memory resource at the time of the construction.
+      mt_function_allocator_storage();
+      ~mt_function_allocator_storage();
+
+      mt_function_allocator_storage
+      ( const mt_function_allocator_storage& ) = delete;
+      mt_function_allocator_storage&
+      operator=( const mt_function_allocator_storage& ) = delete;
+
+      allocation_result allocate();
+
+      // Gives back the block of an allocation whose callable could not be
+      // constructed.
+      void cancel( const allocation_handle& handle );
+
+      bool is_alive( const allocation_handle& handle ) const;
+      const function_storage* pin( const allocation_handle& handle );
+
+      // Returns the function of the handle if it is alive. The calling
+      // thread must be in an epoch_section, which keeps the function alive.
+      const function_storage* lookup( const allocation_handle& handle );
+
+      void unpin( const allocation_handle& handle );
+      void release_one( const allocation_handle& handle );
+      void add_one( const allocation_handle& handle );
+
+      // Reclaims the retired blocks that cannot be observed anymore, if no
+      // other thread is doing it and if the destruction is not deferred.
+      void try_reclaim();
+
+      // When enabled, the retired blocks are not reclaimed by the
+      // releases, the allocations and the calls but only by collect() and
+      // trim().
+      // Disabling the mode collects the pending blocks.
+      void defer_destruction( bool enabled );
+
+      // Reclaims the retired blocks that cannot be observed anymore,
+      // waiting for the lock if needed.
+      void collect();
+
+      allocator_statistics statistics();
+
+      // Creates the blocks such that the next allocations do not grow the
+      // storage until there are count functions in it.
+      void reserve( std::size_t count );
+
+      // Releases the pages of free blocks at the end of the storage. The
+      // pages of the states are kept such that the versions are not
+      // reused.
+      void trim();
+
+      // Trims the storage and releases the unused capacity of the
+      // containers.
+      void shrink_to_fit();
+
+    private:
+      // The version of the block in the high bits, the reference count in
+      // the low bits, such that a handle can be validated with a single
+      // load.
+      typedef std::uint64_t state_type;
+
+      struct retired_node : mpsc_node
+      {
+        epoch_domain::epoch_type epoch;
+        std::size_t id;
+      };
+
+      typedef std::atomic< state_type > block_state;
+
+      template< typename T >
+      using resource_vector = std::vector< T, resource_allocator< T > >;
+
+      struct block
+      {
+        function_storage storage;
+        retired_node retired;
+      };
+
+      static constexpr std::size_t page_size_log2 = 10;
+      static constexpr std::size_t page_size = 1 << page_size_log2;
+      static constexpr std::size_t max_page_count = 1024;
+
+      static_assert
+        ( page_size * max_page_count
+          <= allocation_handle::max_storage_block_count,
+          "The block ids do not fit in the handles." );
+
+    private:
+      block_state& get_state( std::size_t id ) const;
+      block& get_block( std::size_t id ) const;
+      std::size_t grow();
+      void acquire( std::unique_lock< std::mutex >& lock );
+      void reclaim( std::unique_lock< std::mutex >& lock );
+      void trim( std::unique_lock< std::mutex >& lock );
+
+    private:
+      // Pages are never moved, and a page of blocks is freed by trim() only
+      // when all its blocks have been reclaimed, thus a block can be
+      // accessed from its id while other threads are allocating. The states
+      // of the blocks are kept apart from the callables such that a
+      // validity check does not load the callable.
+      memory_resource* const m_resource;
+      std::atomic< block_state* > m_state_pages[ max_page_count ];
+      std::atomic< block* > m_pages[ max_page_count ];
+      std::size_t m_block_count;
+      resource_vector< std::size_t > m_available;
+      std::mutex m_mutex;
+      std::atomic< bool > m_deferred_destruction;
+
+      // The counters are updated with m_mutex locked.
+      std::size_t m_peak_live_count;
+      std::uint64_t m_allocation_count;
+      std::uint64_t m_release_count;
+      std::uint64_t m_contention_count;
+      std::chrono::nanoseconds m_lock_wait_time;
+
+      // The blocks released by any thread, waiting to be moved in
+      // m_retired by the thread reclaiming the blocks.
+      mpsc_queue m_retired_queue;
+      std::atomic< std::size_t > m_retired_count;
+      resource_vector< retired_node* > m_retired;
+    };
+  }
+}
+
+#ifdef WFL_HEADER_ONLY
+  #include "wfl/detail/impl/mt_function_allocator_storage.ipp"
+#else
+// The size classes are the default ones, or the halves of a larger
+// WFL_INLINE_CALLABLE_SIZE.
+#if WFL_INLINE_CALLABLE_SIZE > 256
+extern template class wfl::detail::mt_function_allocator_storage
+  < WFL_INLINE_CALLABLE_SIZE / 16 >;
+extern template class wfl::detail::mt_function_allocator_storage
+  < WFL_INLINE_CALLABLE_SIZE / 8 >;
+extern template class wfl::detail::mt_function_allocator_storage
+  < WFL_INLINE_CALLABLE_SIZE / 4 >;
+extern template class wfl::detail::mt_function_allocator_storage
+  < WFL_INLINE_CALLABLE_SIZE / 2 >;
+extern template class wfl::detail::mt_function_allocator_storage
+  < WFL_INLINE_CALLABLE_SIZE >;
+#else
+extern template class wfl::detail::mt_function_allocator_storage< 16 >;
+extern template class wfl::detail::mt_function_allocator_storage< 32 >;
+extern template class wfl::detail::mt_function_allocator_storage< 64 >;
+extern template class wfl::detail::mt_function_allocator_storage< 128 >;
+extern template class wfl::detail::mt_function_allocator_storage< 256 >;
+#endif
+#endif
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "wfl/memory_resource.hpp"
+
+#include <cstddef>
+#include <new>
+
+namespace wfl
+{
+  namespace detail
+  {
+    // Allocates a page of count value-initialized objects from the given
+    // resource. The pages of the storages never move, thus the address of
+    // a block is stable for the lifetime of its page.
+    template< typename T >
+    T* new_page( memory_resource& resource, std::size_t count )
+    {
+      T* const result
+        ( static_cast< T* >
+          ( resource.allocate( count * sizeof( T ), alignof( T ) ) ) );
+
+      for ( std::size_t i( 0 ); i != count; ++i )
+        new ( result + i ) T();
+
+      return result;
+    }
+
+    template< typename T >
+    void delete_page( T* page, memory_resource& resource, std::size_t count )
+    {
+      if ( page == nullptr )
+        return;
+
+      for ( std::size_t i( 0 ); i != count; ++i )
+        page[ i ].~T();
+
+      resource.deallocate( page, count * sizeof( T ), alignof( T ) );
+    }
+  }
+}
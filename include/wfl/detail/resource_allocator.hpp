@@ -0,0 +1,63 @@
+#pragma once
+
+#include "wfl/memory_resource.hpp"
+
+#include <cstddef>
+
+namespace wfl
+{
+  namespace detail
+  {
+    // A standard allocator drawing its memory from a memory_resource, to
+    // be used by the containers of the storages.
+    template< typename T >
+    class resource_allocator
+    {
+      template< typename U >
+      friend class resource_allocator;
+
+    public:
+      typedef T value_type;
+
+    public:
+      explicit resource_allocator( memory_resource* resource )
+        : m_resource( resource )
+      {
+
+      }
+
+      template< typename U >
+      resource_allocator( const resource_allocator< U >& that )
+        : m_resource( that.m_resource )
+      {
+
+      }
+
+      T* allocate( std::size_t n )
+      {
+        return static_cast< T* >
+          ( m_resource->allocate( n * sizeof( T ), alignof( T ) ) );
+      }
+
+      void deallocate( T* p, std::size_t n )
+      {
+        m_resource->deallocate( p, n * sizeof( T ), alignof( T ) );
+      }
+
+      template< typename U >
+      bool operator==( const resource_allocator< U >& that ) const
+      {
+        return m_resource == that.m_resource;
+      }
+
+      template< typename U >
+      bool operator!=( const resource_allocator< U >& that ) const
+      {
+        return m_resource != that.m_resource;
+      }
+
+    private:
+      memory_resource* m_resource;
+    };
+  }
+}
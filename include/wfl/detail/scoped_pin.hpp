@@ -0,0 +1,46 @@
+#pragma once
+
+namespace wfl
+{
+  namespace detail
+  {
+    // Keeps the function of a handle alive for the lifetime of this object,
+    // such that it can be called even if its last owner is released in the
+    // meantime.
+    template< typename Storage >
+    class scoped_pin
+    {
+    public:
+      typedef typename Storage::allocation_handle allocation_handle;
+      typedef typename Storage::function_storage function_storage;
+      
+    public:
+      scoped_pin( Storage& storage, const allocation_handle& handle )
+        : m_storage( storage ),
+          m_handle( handle ),
+          m_function( m_storage.pin( m_handle ) )
+      {
+
+      }
+
+      scoped_pin( const scoped_pin& ) = delete;
+      scoped_pin& operator=( const scoped_pin& ) = delete;
+
+      ~scoped_pin()
+      {
+        if ( m_function != nullptr )
+          m_storage.unpin( m_handle );
+      }
+
+      const function_storage* get() const
+      {
+        return m_function;
+      }
+
+    private:
+      Storage& m_storage;
+      const allocation_handle m_handle;
+      const function_storage* const m_function;
+    };
+  }
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <functional>
+#include <type_traits>
 
 namespace wfl
 {
@@ -12,15 +13,21 @@ namespace wfl
     template< typename F, typename FunctionAllocator >
     class shared_function;
 
-    template< typename FunctionAllocator, typename... Args >
-    class shared_function< void( Args... ), FunctionAllocator >
+    template< typename FunctionAllocator, typename R, typename... Args >
+    class shared_function< R( Args... ), FunctionAllocator >
     {
-      friend class weak_function< void( Args... ), FunctionAllocator >;
+      friend class weak_function< R( Args... ), FunctionAllocator >;
 
     private:
       typedef FunctionAllocator function_allocator;
-      typedef std::function< void( Args... ) > function_type;
-      typedef shared_function< void( Args... ), FunctionAllocator > self_type;
+      typedef shared_function< R( Args... ), FunctionAllocator > self_type;
+
+      template< typename F >
+      using enable_if_callable =
+        typename std::enable_if
+        <
+          !std::is_same< typename std::decay< F >::type, self_type >::value
+        >::type;
   
     public:
       shared_function() = default;
@@ -30,24 +37,35 @@ namespace wfl
       {
         function_allocator::instance().add_one( m_handle );
       }
+
+      shared_function( self_type&& that )
+        : m_handle( that.m_handle )
+      {
+        that.m_handle = typename function_allocator::allocation_handle();
+      }
   
-      explicit shared_function( function_type f )
+      // The callable is stored directly in the allocator's block.
+      template< typename F, typename = enable_if_callable< F > >
+      explicit shared_function( F&& f )
         : m_handle
-          ( function_allocator::instance().allocate( std::move( f ) ) )
+          ( function_allocator::instance().template allocate< R( Args... ) >
+            ( std::forward< F >( f ) ) )
       {
 
       }
 
       ~shared_function()
       {
-        function_allocator::instance().template release_one< function_type >
-          ( m_handle );
+        function_allocator::instance().release_one( m_handle );
       }
 
-      void operator()( Args... args ) const
+      // The arguments are forwarded up to the callable, such that they are
+      // converted to the types of the signature only once.
+      template< typename... A >
+      R operator()( A&&... args ) const
       {
-        function_allocator::instance().call
-          ( m_handle, std::forward< Args >( args )... );
+        return function_allocator::instance().template call< R, Args... >
+          ( m_handle, std::forward< A >( args )... );
       }
 
       self_type& operator=( const self_type& that )
@@ -56,7 +74,7 @@ namespace wfl
           return *this;
 
         auto& allocator( function_allocator::instance() );
-        allocator.template release_one< function_type >( m_handle );
+        allocator.release_one( m_handle );
       
         m_handle = that.m_handle;
       
@@ -65,20 +83,52 @@ namespace wfl
         return *this;
       }
 
+      self_type& operator=( self_type&& that )
+      {
+        if ( this == &that )
+          return *this;
+
+        function_allocator::instance().release_one( m_handle );
+
+        m_handle = that.m_handle;
+        that.m_handle = typename function_allocator::allocation_handle();
+
+        return *this;
+      }
+
       void reset()
       {
         auto& allocator( function_allocator::instance() );
-        allocator.template release_one< function_type >( m_handle );
+        allocator.release_one( m_handle );
 
         m_handle = typename function_allocator::allocation_handle();
       }
   
-      void reset( function_type f )
+      // If the allocation throws, this function is left empty.
+      template< typename F, typename = enable_if_callable< F > >
+      void reset( F&& f )
       {
-        auto& allocator( function_allocator::instance() );
-        allocator.template release_one< function_type >( m_handle );
+        reset();
+
+        m_handle =
+          function_allocator::instance().template allocate< R( Args... ) >
+          ( std::forward< F >( f ) );
+      }
+
+      // Replaces the function with f if the allocator has room for it,
+      // otherwise leaves this function empty and returns false. The
+      // allocator must provide try_allocate().
+      template< typename F, typename = enable_if_callable< F > >
+      bool try_reset( F&& f )
+      {
+        reset();
+
+        m_handle =
+          function_allocator::instance().template try_allocate< R( Args... ) >
+          ( std::forward< F >( f ) );
 
-        m_handle = allocator.allocate( std::move( f ) );
+        return m_handle.version
+          != function_allocator::allocation_handle::not_a_version;
       }
       
     private:
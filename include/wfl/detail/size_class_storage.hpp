@@ -0,0 +1,406 @@
+#pragma once
+
+#include "wfl/detail/allocation_handle.hpp"
+#include "wfl/detail/allocator_statistics.hpp"
+#include "wfl/detail/callable_storage.hpp"
+#include "wfl/detail/config.hpp"
+
+#include <cstddef>
+#include <tuple>
+#include <utility>
+
+namespace wfl
+{
+  namespace detail
+  {
+    struct remote_release;
+
+    // The callables are stored in blocks of several sizes, such that a
+    // small callable does not waste the memory of a large block and a large
+    // callable does not need a dynamic allocation. Each class is half the
+    // size of the next one, down to the minimal size; with a small largest
+    // class, the first classes have the same size and only the first of
+    // them is used.
+    struct size_classes
+    {
+      static constexpr std::size_t count = 5;
+      static constexpr std::size_t count_log2 = 3;
+      static constexpr std::size_t largest = WFL_INLINE_CALLABLE_SIZE;
+      static constexpr std::size_t minimal_size = 16;
+
+      static_assert
+        ( ( largest >= minimal_size )
+          && ( ( largest & ( largest - 1 ) ) == 0 ),
+          "WFL_INLINE_CALLABLE_SIZE must be a power of two, at least 16." );
+
+      static constexpr std::size_t size( std::size_t index )
+      {
+        return ( ( largest >> ( count - 1 - index ) ) < minimal_size )
+          ? minimal_size
+          : ( largest >> ( count - 1 - index ) );
+      }
+
+      static constexpr std::size_t smallest =
+        ( ( largest >> ( count - 1 ) ) < minimal_size )
+        ? minimal_size
+        : ( largest >> ( count - 1 ) );
+
+      static constexpr std::size_t index_of
+      ( std::size_t size, std::size_t index = 0 )
+      {
+        return ( size <= size_classes::size( index ) )
+          ? index
+          : index_of( size, index + 1 );
+      }
+
+      // The index of the size class where a callable of size bytes is
+      // stored, if it is stored inline.
+      static constexpr std::size_t of_size( std::size_t size )
+      {
+        return ( size <= largest ) ? index_of( size ) : 0;
+      }
+
+      // The index of the size class where a callable of type F is
+      // stored. Callables larger than the largest class are allocated on
+      // the heap and a pointer to them is stored in the smallest class.
+      template< typename F >
+      struct of
+        : std::integral_constant
+          <
+            std::size_t,
+            sized_callable_storage< largest >::template fits_inline< F >::value
+            ? index_of( sizeof( F ) )
+            : 0
+          >
+      {};
+    };
+
+    // A storage for each size class, the index of the class being stored in
+    // the low bits of the handle's id.
+    template< template< std::size_t > class Storage >
+    class size_class_storage
+    {
+    public:
+      typedef detail::allocation_handle allocation_handle;
+      typedef callable_storage function_storage;
+
+      template< std::size_t I >
+      using storage_type = Storage< size_classes::size( I ) >;
+
+      // The results of the release and of the addition of a reference,
+      // which tell if the block belongs to the storage for the storages
+      // of a single thread.
+      typedef decltype
+        ( std::declval< storage_type< 0 >& >()
+          .release_one( std::declval< allocation_handle >() ) )
+      release_result;
+      typedef decltype
+        ( std::declval< storage_type< 0 >& >()
+          .add_one( std::declval< allocation_handle >() ) )
+      add_result;
+
+      template< std::size_t I >
+      struct allocation_result
+      {
+        allocation_handle handle;
+        typename storage_type< I >::function_storage* storage;
+      };
+
+    public:
+      template< std::size_t I >
+      allocation_result< I > allocate()
+      {
+        const typename storage_type< I >::allocation_result result
+          ( std::get< I >( m_storages ).allocate() );
+
+        allocation_result< I > r;
+        r.handle = result.handle;
+        r.handle.id = ( r.handle.id << size_classes::count_log2 ) | I;
+        r.storage = result.storage;
+
+        return r;
+      }
+
+      // Gives back the block of an allocation from allocate< I >() whose
+      // callable could not be constructed.
+      template< std::size_t I >
+      void cancel( const allocation_handle& handle )
+      {
+        std::get< I >( m_storages ).cancel( local_handle( handle ) );
+      }
+
+      bool is_alive( const allocation_handle& handle )
+      {
+        return visit< bool >( handle, is_alive_visitor() );
+      }
+
+      const function_storage* pin( const allocation_handle& handle )
+      {
+        return visit< const function_storage* >( handle, pin_visitor() );
+      }
+
+      const function_storage* lookup( const allocation_handle& handle )
+      {
+        return visit< const function_storage* >( handle, lookup_visitor() );
+      }
+
+      void unpin( const allocation_handle& handle )
+      {
+        visit< void >( handle, unpin_visitor() );
+      }
+
+      release_result release_one( const allocation_handle& handle )
+      {
+        return visit< release_result >( handle, release_one_visitor() );
+      }
+
+      void release( const allocation_handle& handle, std::uint32_t count )
+      {
+        visit< void >( handle, release_visitor{ count } );
+      }
+
+      add_result add_one( const allocation_handle& handle )
+      {
+        return visit< add_result >( handle, add_one_visitor() );
+      }
+
+      void set_owner( void* owner )
+      {
+        std::get< 0 >( m_storages ).set_owner( owner );
+        std::get< 1 >( m_storages ).set_owner( owner );
+        std::get< 2 >( m_storages ).set_owner( owner );
+        std::get< 3 >( m_storages ).set_owner( owner );
+        std::get< 4 >( m_storages ).set_owner( owner );
+      }
+
+      static void* owner( const allocation_handle& handle )
+      {
+        const allocation_handle local( local_handle( handle ) );
+
+        switch ( size_class( handle ) )
+          {
+          case 0: return storage_type< 0 >::owner( local );
+          case 1: return storage_type< 1 >::owner( local );
+          case 2: return storage_type< 2 >::owner( local );
+          case 3: return storage_type< 3 >::owner( local );
+          default: return storage_type< 4 >::owner( local );
+          }
+      }
+
+      static remote_release& remote_node( const allocation_handle& handle )
+      {
+        const allocation_handle local( local_handle( handle ) );
+
+        switch ( size_class( handle ) )
+          {
+          case 0: return storage_type< 0 >::remote_node( local );
+          case 1: return storage_type< 1 >::remote_node( local );
+          case 2: return storage_type< 2 >::remote_node( local );
+          case 3: return storage_type< 3 >::remote_node( local );
+          default: return storage_type< 4 >::remote_node( local );
+          }
+      }
+
+      void try_reclaim( const allocation_handle& handle )
+      {
+        visit< void >( handle, try_reclaim_visitor() );
+      }
+
+      void reserve( std::size_t size_class, std::size_t count )
+      {
+        switch ( size_class )
+          {
+          case 0: std::get< 0 >( m_storages ).reserve( count ); break;
+          case 1: std::get< 1 >( m_storages ).reserve( count ); break;
+          case 2: std::get< 2 >( m_storages ).reserve( count ); break;
+          case 3: std::get< 3 >( m_storages ).reserve( count ); break;
+          default: std::get< 4 >( m_storages ).reserve( count );
+          }
+      }
+
+      void defer_destruction( bool enabled )
+      {
+        std::get< 0 >( m_storages ).defer_destruction( enabled );
+        std::get< 1 >( m_storages ).defer_destruction( enabled );
+        std::get< 2 >( m_storages ).defer_destruction( enabled );
+        std::get< 3 >( m_storages ).defer_destruction( enabled );
+        std::get< 4 >( m_storages ).defer_destruction( enabled );
+      }
+
+      void collect()
+      {
+        std::get< 0 >( m_storages ).collect();
+        std::get< 1 >( m_storages ).collect();
+        std::get< 2 >( m_storages ).collect();
+        std::get< 3 >( m_storages ).collect();
+        std::get< 4 >( m_storages ).collect();
+      }
+
+      void trim()
+      {
+        std::get< 0 >( m_storages ).trim();
+        std::get< 1 >( m_storages ).trim();
+        std::get< 2 >( m_storages ).trim();
+        std::get< 3 >( m_storages ).trim();
+        std::get< 4 >( m_storages ).trim();
+      }
+
+      void shrink_to_fit()
+      {
+        std::get< 0 >( m_storages ).shrink_to_fit();
+        std::get< 1 >( m_storages ).shrink_to_fit();
+        std::get< 2 >( m_storages ).shrink_to_fit();
+        std::get< 3 >( m_storages ).shrink_to_fit();
+        std::get< 4 >( m_storages ).shrink_to_fit();
+      }
+
+      allocator_statistics statistics()
+      {
+        allocator_statistics result
+          ( std::get< 0 >( m_storages ).statistics() );
+
+        result += std::get< 1 >( m_storages ).statistics();
+        result += std::get< 2 >( m_storages ).statistics();
+        result += std::get< 3 >( m_storages ).statistics();
+        result += std::get< 4 >( m_storages ).statistics();
+
+        return result;
+      }
+
+      std::size_t live_count() const
+      {
+        return std::get< 0 >( m_storages ).live_count()
+          + std::get< 1 >( m_storages ).live_count()
+          + std::get< 2 >( m_storages ).live_count()
+          + std::get< 3 >( m_storages ).live_count()
+          + std::get< 4 >( m_storages ).live_count();
+      }
+
+    private:
+      struct is_alive_visitor
+      {
+        template< typename S >
+        bool operator()( S& storage, const allocation_handle& handle ) const
+        {
+          return storage.is_alive( handle );
+        }
+      };
+
+      struct pin_visitor
+      {
+        template< typename S >
+        const function_storage* operator()
+        ( S& storage, const allocation_handle& handle ) const
+        {
+          return storage.pin( handle );
+        }
+      };
+
+      struct lookup_visitor
+      {
+        template< typename S >
+        const function_storage* operator()
+        ( S& storage, const allocation_handle& handle ) const
+        {
+          return storage.lookup( handle );
+        }
+      };
+
+      struct unpin_visitor
+      {
+        template< typename S >
+        void operator()( S& storage, const allocation_handle& handle ) const
+        {
+          storage.unpin( handle );
+        }
+      };
+
+      struct release_one_visitor
+      {
+        template< typename S >
+        release_result
+        operator()( S& storage, const allocation_handle& handle ) const
+        {
+          return storage.release_one( handle );
+        }
+      };
+
+      struct release_visitor
+      {
+        template< typename S >
+        void operator()( S& storage, const allocation_handle& handle ) const
+        {
+          storage.release( handle, count );
+        }
+
+        std::uint32_t count;
+      };
+
+      struct add_one_visitor
+      {
+        template< typename S >
+        add_result
+        operator()( S& storage, const allocation_handle& handle ) const
+        {
+          return storage.add_one( handle );
+        }
+      };
+
+      struct try_reclaim_visitor
+      {
+        template< typename S >
+        void operator()( S& storage, const allocation_handle& ) const
+        {
+          storage.try_reclaim();
+        }
+      };
+
+    private:
+      static std::uint32_t size_class( const allocation_handle& handle )
+      {
+        return handle.id & ( ( 1 << size_classes::count_log2 ) - 1 );
+      }
+
+      static allocation_handle local_handle( const allocation_handle& handle )
+      {
+        allocation_handle result( handle );
+        result.id >>= size_classes::count_log2;
+        return result;
+      }
+
+      // Calls visitor with the storage of the handle's size class and the
+      // handle local to this storage.
+      template< typename R, typename Visitor >
+      R visit( const allocation_handle& handle, const Visitor& visitor )
+      {
+        const allocation_handle local( local_handle( handle ) );
+
+        switch ( size_class( handle ) )
+          {
+          case 0: return visitor( std::get< 0 >( m_storages ), local );
+          case 1: return visitor( std::get< 1 >( m_storages ), local );
+          case 2: return visitor( std::get< 2 >( m_storages ), local );
+          case 3: return visitor( std::get< 3 >( m_storages ), local );
+          default: return visitor( std::get< 4 >( m_storages ), local );
+          }
+      }
+
+    private:
+      static_assert
+        ( allocation_handle::storage_id_bits + size_classes::count_log2 <= 32,
+          "The size class does not fit in the handles." );
+      static_assert
+        ( size_classes::count == 5,
+          "The storages and the visit function must match the classes." );
+
+      std::tuple
+      <
+        storage_type< 0 >,
+        storage_type< 1 >,
+        storage_type< 2 >,
+        storage_type< 3 >,
+        storage_type< 4 >
+      > m_storages;
+    };
+  }
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "wfl/detail/aligned_allocation.hpp"
+#include "wfl/detail/config.hpp"
+#include "wfl/detail/thread_safe_function_allocator.hpp"
+#include "wfl/detail/weak_function.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace wfl
+{
+  namespace detail
+  {
+    // Runs thread-safe weak functions in a fixed set of worker threads.
+    // Each worker has its own queue of tasks, where it pushes the tasks it
+    // submits and from which it takes the most recent ones, and an idle
+    // worker steals the oldest tasks of the others. A task whose shared
+    // function has been destroyed is dropped when it is dequeued, without
+    // being run.
+    class thread_pool
+    {
+    public:
+      typedef
+      weak_function< void(), thread_safe_function_allocator > task_type;
+
+    public:
+      explicit thread_pool( std::size_t worker_count );
+
+      // Waits for the submitted tasks to be run or dropped, then stops the
+      // workers.
+      ~thread_pool();
+
+      thread_pool( const thread_pool& ) = delete;
+      thread_pool& operator=( const thread_pool& ) = delete;
+
+      // Schedules the task for a run in a worker. Can be called from any
+      // thread, including from the tasks.
+      void submit( const task_type& task );
+
+      // The number of tasks run, respectively dropped since they had
+      // expired, since the creation of the pool.
+      std::uint64_t run_count() const;
+      std::uint64_t dropped_count() const;
+
+    private:
+      struct alignas( 64 ) worker_queue
+      {
+        std::mutex mutex;
+        std::deque< task_type > tasks;
+      };
+
+    private:
+      void run( std::size_t worker );
+      bool pop( std::size_t worker, task_type& task );
+      bool steal( std::size_t worker, task_type& task );
+
+    private:
+      std::vector< std::unique_ptr< worker_queue, aligned_deleter > >
+      m_queues;
+      std::vector< std::thread > m_workers;
+
+      // The number of submitted tasks not yet dequeued. It is incremented
+      // before the task is pushed such that a worker never sleeps while a
+      // task is in a queue.
+      std::atomic< std::size_t > m_pending_count;
+      std::atomic< std::size_t > m_next_queue;
+      std::atomic< std::uint64_t > m_run_count;
+      std::atomic< std::uint64_t > m_dropped_count;
+
+      // The number of workers waiting for a task, or about to, such that
+      // the submission of a task notifies them only if needed.
+      std::atomic< std::size_t > m_sleeping_count;
+      std::mutex m_mutex;
+      std::condition_variable m_condition;
+      bool m_stop;
+    };
+  }
+}
+
+#ifdef WFL_HEADER_ONLY
+  #include "wfl/detail/impl/thread_pool.ipp"
+#endif
@@ -1,66 +1,446 @@
 #pragma once
 
+#include "wfl/detail/config.hpp"
 #include "wfl/detail/function_allocator.hpp"
+#include "wfl/detail/function_group_storage.hpp"
+#include "wfl/detail/mt_function_allocator_storage.hpp"
+#include "wfl/detail/scoped_pin.hpp"
+#include "wfl/detail/size_class_storage.hpp"
+#include "wfl/optional.hpp"
 
-#include <mutex>
-#include <thread>
+#include <algorithm>
+#include <atomic>
+#include <type_traits>
+#include <vector>
 
 namespace wfl
 {
   namespace detail
   {
+    // The calls counted by a thread for the statistics of the thread-safe
+    // functions. The records are never freed, they are reused by the
+    // threads created after the death of their owner, thus the counts of
+    // the exited threads are kept.
+    struct alignas( 64 ) call_counters
+    {
+      std::atomic< std::uint64_t > call_count;
+      std::atomic< std::uint64_t > expired_call_count;
+      std::atomic< bool > in_use;
+      call_counters* next;
+    };
+
+    // The functions are spread among several storages, the shards, such that
+    // threads creating and destroying functions concurrently do not contend
+    // on the same lock. The shard of a function is selected by the thread
+    // creating it, and its index is stored in the low bits of the handle's
+    // id.
+    //
+    // The functions of the groups are kept in a separate storage. Their
+    // handles use the size class following the last one, and the index of
+    // their block in the group storage instead of the shard.
     class mt_function_allocator
     {
+      template< typename Storage >
+      friend class scoped_pin;
+
+    private:
+      typedef
+      size_class_storage< mt_function_allocator_storage > storage_type;
+
     public:
-      typedef detail::function_allocator::allocation_handle allocation_handle;
-  
+      typedef storage_type::allocation_handle allocation_handle;
+      typedef storage_type::function_storage function_storage;
+
+      static constexpr std::size_t shard_count_log2 = 4;
+      static constexpr std::size_t shard_count = 1 << shard_count_log2;
+
+      static_assert
+        ( allocation_handle::storage_id_bits + size_classes::count_log2
+          + shard_count_log2
+          <= 32,
+          "The shard index does not fit in the handles." );
+
+      static constexpr std::uint32_t group_class =
+        ( 1 << size_classes::count_log2 ) - 1;
+
+      static_assert
+        ( size_classes::count <= group_class,
+          "There is no size class left for the groups." );
+
     public:
-      template< typename... Args >
-      allocation_handle allocate( std::function< void( Args... ) > f )
+      template< typename Signature, typename F >
+      allocation_handle allocate( F&& f )
+      {
+        constexpr std::size_t size_class
+          ( size_classes::of< typename std::decay< F >::type >::value );
+        const std::size_t shard( current_shard() );
+
+        const storage_type::allocation_result< size_class > result
+          ( m_shards[ shard ].storage.allocate< size_class >() );
+
+        try
+          {
+            result.storage->template construct< Signature >
+              ( std::forward< F >( f ), *get_default_resource() );
+          }
+        catch( ... )
+          {
+            m_shards[ shard ].storage.cancel< size_class >( result.handle );
+            throw;
+          }
+
+        allocation_handle handle( result.handle );
+        handle.id = ( handle.id << shard_count_log2 ) | shard;
+
+        return handle;
+      }
+
+      std::uint32_t create_group()
+      {
+        return m_groups.create();
+      }
+
+      // Stores f in the given group, which must not be used concurrently.
+      template< typename Signature, typename F >
+      allocation_handle allocate_in_group( std::uint32_t group, F&& f )
+      {
+        allocation_handle handle
+          ( m_groups.allocate< Signature >( group, std::forward< F >( f ) ) );
+
+        handle.id = ( handle.id << group_id_shift )
+          | ( group_class << shard_count_log2 );
+
+        return handle;
+      }
+
+      // Expires all the functions of the group at once. Their callables are
+      // destroyed as soon as no caller can observe them.
+      void release_group( std::uint32_t group )
       {
-        const std::lock_guard< std::recursive_mutex > lock( m_mutex );
-        return m_allocator.allocate( std::move( f ) );
+        m_groups.release( group );
       }
 
-      template< typename... Args >
-      void call( const allocation_handle& handle, Args&&... args )
+      // R and Args are the result and the parameters of the function's
+      // signature, A the types of the arguments, forwarded as is up to the
+      // function.
+      template< typename R, typename... Args, typename... A >
+      R call( const allocation_handle& handle, A&&... args )
       {
-        const std::lock_guard< std::recursive_mutex > lock( m_mutex );
-        return m_allocator.call( handle, std::forward< Args >( args )... );
+        const scoped_pin< mt_function_allocator > function( *this, handle );
+
+        wfl_debug_assert( function.get() != nullptr );
+
+        return function.get()->template invoke< R, Args... >
+          ( argument< Args >::pass( std::forward< A >( args ) )... );
       }
   
-      template< typename... Args >
-      void safe_call( const allocation_handle& handle, Args&&... args )
+      template< typename R, typename... Args, typename... A >
+      typename std::enable_if< std::is_void< R >::value >::type
+      safe_call( const allocation_handle& handle, A&&... args )
       {
-        const std::lock_guard< std::recursive_mutex > lock( m_mutex );
-        return m_allocator.safe_call( handle, std::forward< Args >( args )... );
+        const scoped_pin< mt_function_allocator > function( *this, handle );
+        count_call( function.get() != nullptr );
+
+        if ( function.get() == nullptr )
+          return;
+
+        function.get()->template invoke< R, Args... >
+          ( argument< Args >::pass( std::forward< A >( args ) )... );
+      }
+
+      // The result of the function is constructed directly in the returned
+      // optional, which is empty if the function has expired.
+      template< typename R, typename... Args, typename... A >
+      typename std::enable_if< !std::is_void< R >::value, optional< R > >::type
+      safe_call( const allocation_handle& handle, A&&... args )
+      {
+        const scoped_pin< mt_function_allocator > function( *this, handle );
+        count_call( function.get() != nullptr );
+
+        if ( function.get() == nullptr )
+          return optional< R >();
+
+        return optional< R >
+          ( in_place_invoke,
+            [ & ]() -> R
+            {
+              return function.get()->template invoke< R, Args... >
+                ( argument< Args >::pass( std::forward< A >( args ) )... );
+            } );
+      }
+
+      // Calls the functions of the given handles with the same arguments,
+      // in the order of their blocks, and returns the number of functions
+      // that were alive. The handles are sorted by this function and the
+      // ones of the expired functions are removed. The calling thread
+      // stays in a single critical section during the whole batch.
+      template< typename R, typename... Args >
+      std::size_t safe_call_all
+      ( std::vector< allocation_handle >& handles,
+        typename std::add_lvalue_reference< Args >::type... args )
+      {
+        return safe_call_all_until< R, Args... >
+          ( handles, never_stop(), args... );
+      }
+
+      // Like safe_call_all(), but stops before the next function as soon
+      // as stop() returns true. The handles not visited are kept.
+      template< typename R, typename... Args, typename Stop >
+      std::size_t safe_call_all_until
+      ( std::vector< allocation_handle >& handles, const Stop& stop,
+        typename std::add_lvalue_reference< Args >::type... args )
+      {
+        constexpr std::size_t storage_bits
+          ( size_classes::count_log2 + shard_count_log2 );
+
+        const block_order order( storage_bits );
+
+        if ( !std::is_sorted( handles.begin(), handles.end(), order ) )
+          std::sort( handles.begin(), handles.end(), order );
+
+        std::size_t visited( 0 );
+        std::size_t result( 0 );
+
+        {
+          handle_sweep sweep( handles );
+
+          for ( ; !sweep.done() && !stop(); ++visited )
+            {
+              // Each call has its own critical section, such that a slow
+              // function delays the reclamation of the blocks released
+              // during its own call only, not during the whole batch.
+              const epoch_section section;
+              const allocation_handle handle( sweep.next() );
+              const function_storage* const function( lookup( handle ) );
+
+              if ( function == nullptr )
+                continue;
+
+              sweep.keep( handle );
+              ++result;
+              function->template invoke< R, Args... >
+                ( repeated_argument< Args >::pass( args )... );
+            }
+        }
+
+        call_counters& counters( this_thread_call_counters() );
+        add( counters.call_count, result );
+        add( counters.expired_call_count, visited - result );
+
+        // The blocks released during the batch are reclaimed once the
+        // critical sections are over.
+        constexpr std::uint32_t storage_mask( ( 1 << storage_bits ) - 1 );
+
+        for ( std::size_t i( 0 ); i != handles.size(); ++i )
+          if ( ( i == 0 )
+               || ( ( handles[ i ].id & storage_mask )
+                    != ( handles[ i - 1 ].id & storage_mask ) ) )
+            {
+              if ( is_grouped( handles[ i ] ) )
+                m_groups.try_reclaim();
+              else
+                get_storage( handles[ i ] ).try_reclaim
+                  ( local_handle( handles[ i ] ) );
+            }
+
+        return result;
+      }
+
+      bool is_alive( const allocation_handle& handle )
+      {
+        if ( is_grouped( handle ) )
+          return m_groups.is_alive( group_handle( handle ) );
+
+        return get_storage( handle ).is_alive( local_handle( handle ) );
       }
 
-      template< typename F >
       void release_one( const allocation_handle& handle )
       {
-        const std::lock_guard< std::recursive_mutex > lock( m_mutex );
-        m_allocator.release_one< F >( handle );
+        get_storage( handle ).release_one( local_handle( handle ) );
       }
 
       void add_one( const allocation_handle& handle )
       {
-        const std::lock_guard< std::recursive_mutex > lock( m_mutex );
-        m_allocator.add_one( handle );
+        get_storage( handle ).add_one( local_handle( handle ) );
       }
-  
+
+      // The calls are counted by each thread in its own record, such that
+      // the threads do not share the cache lines of the counters, and the
+      // records are summed here. There is a single thread-safe allocator,
+      // thus the records are not specific to an instance.
+      allocator_statistics statistics()
+      {
+        allocator_statistics result;
+
+        for ( shard& s : m_shards )
+          result += s.storage.statistics();
+
+        for ( const call_counters* c( all_call_counters() ); c != nullptr;
+              c = c->next )
+          {
+            result.call_count +=
+              c->call_count.load( std::memory_order_relaxed );
+            result.expired_call_count +=
+              c->expired_call_count.load( std::memory_order_relaxed );
+          }
+
+        return result;
+      }
+
+      // Prepares the storages for count functions whose callable is at most
+      // size bytes. The functions being spread among the shards, each shard
+      // reserves its part of count.
+      void reserve( std::size_t count, std::size_t size )
+      {
+        const std::size_t size_class( size_classes::of_size( size ) );
+        const std::size_t shard_part
+          ( ( count + shard_count - 1 ) / shard_count );
+
+        for ( shard& s : m_shards )
+          s.storage.reserve( size_class, shard_part );
+      }
+
+      // When enabled, the released functions are not destroyed by their
+      // release, the next allocation or call but only by collect(), trim()
+      // or when the mode is disabled. See background_collector to run the
+      // collection in a dedicated thread.
+      void defer_destruction( bool enabled )
+      {
+        for ( shard& s : m_shards )
+          s.storage.defer_destruction( enabled );
+
+        m_groups.defer_destruction( enabled );
+      }
+
+      // Destroys the released functions that cannot be observed by a
+      // caller anymore. The others are kept for a later collection.
+      void collect()
+      {
+        for ( shard& s : m_shards )
+          s.storage.collect();
+
+        m_groups.collect();
+      }
+
+      // Releases the memory of the free blocks at the end of the storages
+      // and of the blocks of the expired groups.
+      void trim()
+      {
+        for ( shard& s : m_shards )
+          s.storage.trim();
+
+        m_groups.trim();
+      }
+
+      void shrink_to_fit()
+      {
+        for ( shard& s : m_shards )
+          s.storage.shrink_to_fit();
+
+        m_groups.shrink_to_fit();
+      }
+
+    private:
+      struct alignas( 64 ) shard
+      {
+        storage_type storage;
+      };
+
+      static constexpr std::size_t group_id_shift =
+        size_classes::count_log2 + shard_count_log2;
+
+      static_assert
+        ( allocation_handle::storage_id_bits + group_id_shift <= 32,
+          "The block of a group does not fit in the handles." );
+
+    private:
+      static std::size_t current_shard();
+      static call_counters& this_thread_call_counters();
+      static const call_counters* all_call_counters();
+
+      static bool is_grouped( const allocation_handle& handle )
+      {
+        return ( ( handle.id >> shard_count_log2 )
+                 & ( ( 1 << size_classes::count_log2 ) - 1 ) )
+          == group_class;
+      }
+
+      static allocation_handle group_handle( const allocation_handle& handle )
+      {
+        allocation_handle result( handle );
+        result.id >>= group_id_shift;
+        return result;
+      }
+
+      static void count_call( bool alive )
+      {
+        call_counters& counters( this_thread_call_counters() );
+
+        if ( alive )
+          add( counters.call_count, 1 );
+        else
+          add( counters.expired_call_count, 1 );
+      }
+
+      // Only the thread owning the record writes in its counters, thus
+      // they are incremented without a read-modify-write.
+      static void add
+      ( std::atomic< std::uint64_t >& counter, std::uint64_t value )
+      {
+        counter.store
+          ( counter.load( std::memory_order_relaxed ) + value,
+            std::memory_order_relaxed );
+      }
+
+      static allocation_handle local_handle( const allocation_handle& handle )
+      {
+        allocation_handle result( handle );
+        result.id >>= shard_count_log2;
+        return result;
+      }
+
+      storage_type& get_storage( const allocation_handle& handle )
+      {
+        return m_shards[ handle.id & ( shard_count - 1 ) ].storage;
+      }
+
+      const function_storage* pin( const allocation_handle& handle )
+      {
+        if ( is_grouped( handle ) )
+          return m_groups.pin( group_handle( handle ) );
+
+        return get_storage( handle ).pin( local_handle( handle ) );
+      }
+
+      const function_storage* lookup( const allocation_handle& handle )
+      {
+        if ( is_grouped( handle ) )
+          return m_groups.lookup( group_handle( handle ) );
+
+        return get_storage( handle ).lookup( local_handle( handle ) );
+      }
+
+      void unpin( const allocation_handle& handle )
+      {
+        if ( is_grouped( handle ) )
+          m_groups.unpin( group_handle( handle ) );
+        else
+          get_storage( handle ).unpin( local_handle( handle ) );
+      }
+
     private:
-      detail::function_allocator m_allocator;
-      std::recursive_mutex m_mutex;
+      shard m_shards[ shard_count ];
+      function_group_storage m_groups;
     };
 
     struct thread_safe_function_allocator
     {
       typedef mt_function_allocator::allocation_handle allocation_handle;
       static mt_function_allocator& instance();
-
-    private:
-      static mt_function_allocator s_instance;
     };
   }
 }
+
+#ifdef WFL_HEADER_ONLY
+  #include "wfl/detail/impl/thread_safe_function_allocator.ipp"
+#endif
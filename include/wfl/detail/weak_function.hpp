@@ -1,6 +1,9 @@
 #pragma once
 
 #include "wfl/detail/shared_function.hpp"
+#include "wfl/optional.hpp"
+
+#include <vector>
 
 namespace wfl
 {
@@ -9,15 +12,35 @@ namespace wfl
     template< typename F, typename FunctionAllocator >
     class weak_function;
 
-    template< typename FunctionAllocator, typename... Args >
-    class weak_function< void( Args... ), FunctionAllocator >
+    template< typename F, typename FunctionAllocator >
+    class callback_list;
+
+    class function_group;
+
+    template< typename FunctionAllocator, typename R, typename... Args >
+    class weak_function< R( Args... ), FunctionAllocator >
     {
+      friend class call_dispatcher;
+      friend class function_group;
+      friend class callback_list< R( Args... ), FunctionAllocator >;
+
+    public:
+      // The result of a call: nothing for functions returning void, an
+      // optional result otherwise, empty if the function has expired.
+      typedef
+      typename std::conditional
+      <
+        std::is_void< R >::value,
+        void,
+        optional< R >
+      >::type
+      result_type;
+
     private:
       typedef FunctionAllocator function_allocator;
-      typedef std::function< void( Args... ) > function_type;
       typedef
-      shared_function< void( Args... ), FunctionAllocator > matching_shared;
-      typedef weak_function< void( Args... ), FunctionAllocator > self_type;
+      shared_function< R( Args... ), FunctionAllocator > matching_shared;
+      typedef weak_function< R( Args... ), FunctionAllocator > self_type;
       
     public:
       weak_function() = default;
@@ -45,12 +68,60 @@ namespace wfl
       self_type& operator=( const self_type& ) = default;
       self_type& operator=( self_type&& f ) = default;
 
-      void operator()( Args... args ) const
+      // Tells if the function has been released. In a multithreaded
+      // context, the function may expire right after this check.
+      bool expired() const
+      {
+        return !function_allocator::instance().is_alive( m_handle );
+      }
+
+      template< typename... A >
+      result_type operator()( A&&... args ) const
+      {
+        return function_allocator::instance().template safe_call
+          < R, Args... >
+          ( m_handle, std::forward< A >( args )... );
+      }
+
+      // Calls all the functions in [first, last) with the same arguments
+      // and returns the number of functions that were alive. The functions
+      // are called in the order of their storage, not in the order of the
+      // range.
+      template< typename Iterator >
+      static std::size_t call_all
+      ( Iterator first, Iterator last, Args... args )
       {
-        function_allocator::instance().safe_call
-          ( m_handle, std::forward< Args >( args )... );
+        // The handles are collected in a buffer kept by the thread. It is
+        // taken for the duration of the call, thus a nested call from one
+        // of the functions uses a buffer of its own.
+        static thread_local handle_vector buffer;
+        handle_vector handles;
+        handles.swap( buffer );
+        handles.clear();
+
+        for ( ; first != last; ++first )
+          handles.emplace_back( first->m_handle );
+
+        const std::size_t result
+          ( function_allocator::instance().template safe_call_all
+            < R, Args... >( handles, args... ) );
+
+        handles.swap( buffer );
+        return result;
       }
   
+    private:
+      typedef std::vector< typename function_allocator::allocation_handle >
+      handle_vector;
+
+    private:
+      explicit weak_function
+      ( const typename function_allocator::allocation_handle& handle )
+        : m_handle( handle )
+      {
+
+      }
+
     private:
       typename function_allocator::allocation_handle m_handle;
     };
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "wfl/detail/fixed_function_allocator.hpp"
+#include "wfl/detail/shared_function.hpp"
+#include "wfl/detail/weak_function.hpp"
+
+#include <cstddef>
+
+namespace wfl
+{
+  // The functions of a thread which must not allocate memory after its
+  // initialization. Each thread has Capacity blocks of Size bytes,
+  // allocated by the first function of the thread, or by a call to
+  // fixed_capacity_function_allocator< Capacity, Size >::instance(). The
+  // functions must not leave their thread.
+  template< std::size_t Capacity, std::size_t Size = 64 >
+  using fixed_capacity_function_allocator =
+    detail::fixed_capacity_function_allocator< Capacity, Size >;
+
+  template< typename F, std::size_t Capacity, std::size_t Size = 64 >
+  using fixed_shared_function =
+    detail::shared_function
+    <
+      F,
+      fixed_capacity_function_allocator< Capacity, Size >
+    >;
+
+  template< typename F, std::size_t Capacity, std::size_t Size = 64 >
+  using fixed_weak_function =
+    detail::weak_function
+    <
+      F,
+      fixed_capacity_function_allocator< Capacity, Size >
+    >;
+}
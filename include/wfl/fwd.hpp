@@ -10,6 +10,9 @@ namespace wfl
     template< typename F, typename FunctionAllocator >
     class shared_function;
 
+    template< typename F, typename FunctionAllocator >
+    class callback_list;
+
     class thread_local_function_allocator;
   }
   
@@ -20,4 +23,8 @@ namespace wfl
   template< typename F >
   using shared_function =
     detail::shared_function< F, detail::thread_local_function_allocator >;
+
+  template< typename F >
+  using callback_list =
+    detail::callback_list< F, detail::thread_local_function_allocator >;
 }
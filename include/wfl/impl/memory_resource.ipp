@@ -0,0 +1,74 @@
+#pragma once
+
+#include "wfl/memory_resource.hpp"
+
+#include "wfl/detail/aligned_allocation.hpp"
+
+#include <atomic>
+#include <new>
+#include <type_traits>
+
+namespace wfl
+{
+  namespace detail
+  {
+    class new_delete_memory_resource:
+      public memory_resource
+    {
+    private:
+      void* do_allocate( std::size_t bytes, std::size_t alignment ) override
+      {
+        return aligned_allocate( bytes, alignment );
+      }
+
+      void do_deallocate
+      ( void* p, std::size_t, std::size_t alignment ) override
+      {
+        aligned_deallocate( p, alignment );
+      }
+    };
+
+    // Null stands for new_delete_resource(), such that the resource can be
+    // used during the static initialization.
+    wfl_inline std::atomic< memory_resource* >& default_resource()
+    {
+      static std::atomic< memory_resource* > result( nullptr );
+      return result;
+    }
+
+    wfl_inline memory_resource*
+    resource_or_default( memory_resource* resource )
+    {
+      return ( resource == nullptr ) ? wfl::new_delete_resource() : resource;
+    }
+  }
+}
+
+wfl_inline wfl::memory_resource::~memory_resource() = default;
+
+// The resource is never destroyed since the static allocators may release
+// their memory after the destruction of the function-local statics.
+wfl_inline wfl::memory_resource* wfl::new_delete_resource()
+{
+  static std::aligned_storage
+    <
+      sizeof( detail::new_delete_memory_resource ),
+      alignof( detail::new_delete_memory_resource )
+    >::type storage;
+  static memory_resource* const result
+    ( new ( &storage ) detail::new_delete_memory_resource() );
+
+  return result;
+}
+
+wfl_inline wfl::memory_resource*
+wfl::set_default_resource( memory_resource* resource )
+{
+  return detail::resource_or_default
+    ( detail::default_resource().exchange( resource ) );
+}
+
+wfl_inline wfl::memory_resource* wfl::get_default_resource()
+{
+  return detail::resource_or_default( detail::default_resource().load() );
+}
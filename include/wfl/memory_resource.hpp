@@ -0,0 +1,55 @@
+#pragma once
+
+#include "wfl/detail/config.hpp"
+
+#include <cstddef>
+
+namespace wfl
+{
+  // The source of the memory of the allocators: the pages of blocks and
+  // the callables too large to be stored in a block. This is the interface
+  // of std::pmr::memory_resource, available before C++17.
+  class memory_resource
+  {
+  public:
+    virtual ~memory_resource();
+
+    void* allocate
+    ( std::size_t bytes,
+      std::size_t alignment = alignof( std::max_align_t ) )
+    {
+      return do_allocate( bytes, alignment );
+    }
+
+    void deallocate
+    ( void* p, std::size_t bytes,
+      std::size_t alignment = alignof( std::max_align_t ) )
+    {
+      do_deallocate( p, bytes, alignment );
+    }
+
+  private:
+    virtual void* do_allocate( std::size_t bytes, std::size_t alignment ) = 0;
+    virtual void do_deallocate
+    ( void* p, std::size_t bytes, std::size_t alignment ) = 0;
+  };
+
+  // A resource using the global operator new and operator delete. This is
+  // the default resource.
+  memory_resource* new_delete_resource();
+
+  // Sets the resource used by the storages created after this call, for
+  // their blocks and their containers, and by the callables allocated
+  // after it by the thread-safe allocator. Since the allocators are created
+  // by the first allocation in their thread, or in the program for the
+  // thread-safe one, a resource set at startup is used by all of them. The
+  // resource must outlive the functions allocated from it and the storages
+  // using it; the storages of the thread-safe allocator are destroyed at
+  // the end of the program. Returns the previous resource.
+  memory_resource* set_default_resource( memory_resource* resource );
+  memory_resource* get_default_resource();
+}
+
+#ifdef WFL_HEADER_ONLY
+  #include "wfl/impl/memory_resource.ipp"
+#endif
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "wfl/detail/call_dispatcher.hpp"
+
+namespace wfl
+{
+  namespace mt
+  {
+    typedef wfl::detail::call_dispatcher call_dispatcher;
+  }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "wfl/detail/callback_list.hpp"
+#include "wfl/detail/thread_safe_function_allocator.hpp"
+
+namespace wfl
+{
+  namespace mt
+  {
+    template< typename F >
+    using callback_list =
+      wfl::detail::callback_list
+      <
+        F,
+        wfl::detail::thread_safe_function_allocator
+      >;
+  }
+}
+
+#ifndef WFL_HEADER_ONLY
+extern template class wfl::detail::callback_list
+<
+  void(),
+  wfl::detail::thread_safe_function_allocator
+>;
+#endif
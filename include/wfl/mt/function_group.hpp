@@ -0,0 +1,13 @@
+#pragma once
+
+#include "wfl/detail/function_group.hpp"
+
+namespace wfl
+{
+  namespace mt
+  {
+    // Functions expiring together with their group. A group holds at most
+    // function_group::max_size functions, that is 256.
+    typedef wfl::detail::function_group function_group;
+  }
+}
@@ -10,7 +10,13 @@ namespace wfl
     template< typename F, typename FunctionAllocator >
     class shared_function;
 
+    template< typename F, typename FunctionAllocator >
+    class callback_list;
+
     class thread_safe_function_allocator;
+    class call_dispatcher;
+    class function_group;
+    class thread_pool;
   }
 
   namespace mt
@@ -30,5 +36,17 @@ namespace wfl
         F,
         wfl::detail::thread_safe_function_allocator
       >;
+
+    template< typename F >
+    using callback_list =
+      wfl::detail::callback_list
+      <
+        F,
+        wfl::detail::thread_safe_function_allocator
+      >;
+
+    typedef wfl::detail::call_dispatcher call_dispatcher;
+    typedef wfl::detail::function_group function_group;
+    typedef wfl::detail::thread_pool thread_pool;
   }
 }
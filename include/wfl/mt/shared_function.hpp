@@ -17,8 +17,10 @@ namespace wfl
   }
 }
 
+#ifndef WFL_HEADER_ONLY
 extern template class wfl::detail::shared_function
 <
   void(),
   wfl::detail::thread_safe_function_allocator
 >;
+#endif
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "wfl/detail/thread_pool.hpp"
+
+namespace wfl
+{
+  namespace mt
+  {
+    typedef wfl::detail::thread_pool thread_pool;
+  }
+}
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace wfl
+{
+  // Tag to construct an optional from the result of a function.
+  struct in_place_invoke_t {};
+  constexpr in_place_invoke_t in_place_invoke{};
+
+  // The result of a call through a weak function, empty if the function
+  // has expired. This is a minimal equivalent of C++17's std::optional.
+  template< typename T >
+  class optional
+  {
+  public:
+    typedef T value_type;
+
+  public:
+    optional()
+      : m_has_value( false )
+    {
+
+    }
+
+    optional( T value )
+      : m_has_value( true )
+    {
+      new ( &m_storage ) T( std::move( value ) );
+    }
+
+    // Stores the result of f() without any intermediate copy.
+    template< typename F >
+    optional( in_place_invoke_t, F&& f )
+      : m_has_value( false )
+    {
+      new ( &m_storage ) T( std::forward< F >( f )() );
+      m_has_value = true;
+    }
+
+    optional( const optional& that )
+      : m_has_value( false )
+    {
+      if ( that.m_has_value )
+        {
+          new ( &m_storage ) T( *that );
+          m_has_value = true;
+        }
+    }
+
+    optional( optional&& that )
+      : m_has_value( false )
+    {
+      if ( that.m_has_value )
+        {
+          new ( &m_storage ) T( std::move( *that ) );
+          m_has_value = true;
+        }
+    }
+
+    ~optional()
+    {
+      reset();
+    }
+
+    optional& operator=( const optional& that )
+    {
+      if ( this == &that )
+        return *this;
+
+      reset();
+
+      if ( that.m_has_value )
+        {
+          new ( &m_storage ) T( *that );
+          m_has_value = true;
+        }
+
+      return *this;
+    }
+
+    optional& operator=( optional&& that )
+    {
+      if ( this == &that )
+        return *this;
+
+      reset();
+
+      if ( that.m_has_value )
+        {
+          new ( &m_storage ) T( std::move( *that ) );
+          m_has_value = true;
+        }
+
+      return *this;
+    }
+
+    bool has_value() const
+    {
+      return m_has_value;
+    }
+
+    explicit operator bool() const
+    {
+      return m_has_value;
+    }
+
+    T& operator*()
+    {
+      return *reinterpret_cast< T* >( &m_storage );
+    }
+
+    const T& operator*() const
+    {
+      return *reinterpret_cast< const T* >( &m_storage );
+    }
+
+    T* operator->()
+    {
+      return &**this;
+    }
+
+    const T* operator->() const
+    {
+      return &**this;
+    }
+
+    template< typename U >
+    T value_or( U&& default_value ) const
+    {
+      if ( m_has_value )
+        return **this;
+
+      return static_cast< T >( std::forward< U >( default_value ) );
+    }
+
+    void reset()
+    {
+      if ( !m_has_value )
+        return;
+
+      ( **this ).~T();
+      m_has_value = false;
+    }
+
+  private:
+    typename std::aligned_storage< sizeof( T ), alignof( T ) >::type
+    m_storage;
+    bool m_has_value;
+  };
+
+  // An optional reference is stored as a pointer.
+  template< typename T >
+  class optional< T& >
+  {
+  public:
+    typedef T& value_type;
+
+  public:
+    optional()
+      : m_value( nullptr )
+    {
+
+    }
+
+    optional( T& value )
+      : m_value( &value )
+    {
+
+    }
+
+    template< typename F >
+    optional( in_place_invoke_t, F&& f )
+      : m_value( &std::forward< F >( f )() )
+    {
+
+    }
+
+    bool has_value() const
+    {
+      return m_value != nullptr;
+    }
+
+    explicit operator bool() const
+    {
+      return m_value != nullptr;
+    }
+
+    T& operator*() const
+    {
+      return *m_value;
+    }
+
+    T* operator->() const
+    {
+      return m_value;
+    }
+
+    void reset()
+    {
+      m_value = nullptr;
+    }
+
+  private:
+    T* m_value;
+  };
+}
@@ -10,8 +10,10 @@ namespace wfl
     detail::shared_function< F, detail::thread_local_function_allocator >;
 }
 
+#ifndef WFL_HEADER_ONLY
 extern template class wfl::detail::shared_function
 <
   void(),
   wfl::detail::thread_local_function_allocator
 >;
+#endif
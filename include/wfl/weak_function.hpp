@@ -10,8 +10,10 @@ namespace wfl
     detail::weak_function< F, detail::thread_local_function_allocator >;
 }
 
+#ifndef WFL_HEADER_ONLY
 extern template class wfl::detail::weak_function
 <
   void(),
   wfl::detail::thread_local_function_allocator
 >;
+#endif
@@ -0,0 +1,14 @@
+#include "wfl/callback_list.hpp"
+#include "wfl/mt/callback_list.hpp"
+
+template class wfl::detail::callback_list
+<
+  void(),
+  wfl::detail::thread_local_function_allocator
+>;
+
+template class wfl::detail::callback_list
+<
+  void(),
+  wfl::detail::thread_safe_function_allocator
+>;
@@ -0,0 +1,2 @@
+#include "wfl/detail/allocator_statistics.hpp"
+#include "wfl/detail/impl/allocator_statistics.ipp"
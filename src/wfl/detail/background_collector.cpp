@@ -0,0 +1,2 @@
+#include "wfl/detail/background_collector.hpp"
+#include "wfl/detail/impl/background_collector.ipp"
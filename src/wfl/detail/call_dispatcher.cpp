@@ -0,0 +1,2 @@
+#include "wfl/detail/call_dispatcher.hpp"
+#include "wfl/detail/impl/call_dispatcher.ipp"
@@ -0,0 +1,2 @@
+#include "wfl/detail/epoch_domain.hpp"
+#include "wfl/detail/impl/epoch_domain.ipp"
@@ -0,0 +1,2 @@
+#include "wfl/detail/function_group.hpp"
+#include "wfl/detail/impl/function_group.ipp"
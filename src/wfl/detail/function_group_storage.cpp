@@ -0,0 +1,2 @@
+#include "wfl/detail/function_group_storage.hpp"
+#include "wfl/detail/impl/function_group_storage.ipp"
@@ -0,0 +1,2 @@
+#include "wfl/detail/mpsc_queue.hpp"
+#include "wfl/detail/impl/mpsc_queue.ipp"
@@ -0,0 +1,21 @@
+#include "wfl/detail/mt_function_allocator_storage.hpp"
+#include "wfl/detail/impl/mt_function_allocator_storage.ipp"
+
+#if WFL_INLINE_CALLABLE_SIZE > 256
+template class wfl::detail::mt_function_allocator_storage
+  < WFL_INLINE_CALLABLE_SIZE / 16 >;
+template class wfl::detail::mt_function_allocator_storage
+  < WFL_INLINE_CALLABLE_SIZE / 8 >;
+template class wfl::detail::mt_function_allocator_storage
+  < WFL_INLINE_CALLABLE_SIZE / 4 >;
+template class wfl::detail::mt_function_allocator_storage
+  < WFL_INLINE_CALLABLE_SIZE / 2 >;
+template class wfl::detail::mt_function_allocator_storage
+  < WFL_INLINE_CALLABLE_SIZE >;
+#else
+template class wfl::detail::mt_function_allocator_storage< 16 >;
+template class wfl::detail::mt_function_allocator_storage< 32 >;
+template class wfl::detail::mt_function_allocator_storage< 64 >;
+template class wfl::detail::mt_function_allocator_storage< 128 >;
+template class wfl::detail::mt_function_allocator_storage< 256 >;
+#endif
@@ -0,0 +1,2 @@
+#include "wfl/detail/thread_pool.hpp"
+#include "wfl/detail/impl/thread_pool.ipp"
@@ -0,0 +1,2 @@
+#include "wfl/memory_resource.hpp"
+#include "wfl/impl/memory_resource.ipp"
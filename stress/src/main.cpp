@@ -0,0 +1,523 @@
+// Load generator for the thread-safe functions. Creator threads allocate
+// functions and publish weak references to them in a shared table, caller
+// threads call random entries of the table, and destroyer threads release
+// the functions handed over by the creators. Each round reports the
+// throughput and the latency percentiles of each operation.
+#include "wfl/mt/shared_function.hpp"
+#include "wfl/mt/weak_function.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace wfl
+{
+  namespace stress
+  {
+    typedef wfl::mt::shared_function< bool() > shared_function;
+    typedef wfl::mt::weak_function< bool() > weak_function;
+    typedef std::chrono::steady_clock clock;
+
+    // A log-linear histogram of durations in nanoseconds: each power of two
+    // is split in sub_bucket_count buckets, thus the relative error of a
+    // percentile is below 1 / sub_bucket_count.
+    class histogram
+    {
+    public:
+      histogram()
+        : m_buckets( bucket_count, 0 ),
+          m_count( 0 )
+      {
+
+      }
+
+      void record( std::uint64_t value )
+      {
+        ++m_buckets[ bucket_of( value ) ];
+        ++m_count;
+      }
+
+      void merge( const histogram& that )
+      {
+        for ( std::size_t i( 0 ); i != bucket_count; ++i )
+          m_buckets[ i ] += that.m_buckets[ i ];
+
+        m_count += that.m_count;
+      }
+
+      std::uint64_t count() const
+      {
+        return m_count;
+      }
+
+      // The lowest value of the bucket containing the given percentile.
+      std::uint64_t percentile( double p ) const
+      {
+        const std::uint64_t rank( std::uint64_t( p / 100 * m_count ) );
+        std::uint64_t seen( 0 );
+
+        for ( std::size_t i( 0 ); i != bucket_count; ++i )
+          {
+            seen += m_buckets[ i ];
+
+            if ( seen > rank )
+              return lowest_value( i );
+          }
+
+        return 0;
+      }
+
+    private:
+      static constexpr std::size_t sub_bucket_bits = 4;
+      static constexpr std::size_t sub_bucket_count = 1 << sub_bucket_bits;
+      static constexpr std::size_t bucket_count =
+        ( 64 - sub_bucket_bits + 1 ) * sub_bucket_count;
+
+    private:
+      static std::size_t bucket_of( std::uint64_t value )
+      {
+        if ( value < sub_bucket_count )
+          return value;
+
+        std::size_t log2( 0 );
+
+        while ( ( value >> log2 ) >= 2 * sub_bucket_count )
+          ++log2;
+
+        return ( log2 + 1 ) * sub_bucket_count
+          + ( ( value >> log2 ) - sub_bucket_count );
+      }
+
+      static std::uint64_t lowest_value( std::size_t bucket )
+      {
+        if ( bucket < sub_bucket_count )
+          return bucket;
+
+        const std::size_t log2( bucket / sub_bucket_count - 1 );
+
+        return ( sub_bucket_count + bucket % sub_bucket_count ) << log2;
+      }
+
+    private:
+      std::vector< std::uint64_t > m_buckets;
+      std::uint64_t m_count;
+    };
+
+    struct options
+    {
+      std::vector< std::size_t > creators{ 1, 2, 4 };
+      std::vector< std::size_t > callers{ 1, 2, 4 };
+      std::vector< std::size_t > destroyers{ 1, 2, 4 };
+      std::size_t callable_size = 16;
+      double expired_ratio = 0.5;
+      std::size_t slot_count = 4096;
+      std::size_t live_per_creator = 256;
+      std::chrono::milliseconds duration{ 1000 };
+    };
+
+    struct thread_result
+    {
+      histogram allocate;
+      histogram call;
+      histogram release;
+      std::uint64_t expired_call_count = 0;
+    };
+
+    // The functions released by the creators, waiting for a destroyer. The
+    // creators push them in batches to keep the contention of this queue
+    // away from the measures.
+    class release_queue
+    {
+    public:
+      void push( std::vector< shared_function >& functions )
+      {
+        const std::lock_guard< std::mutex > lock( m_mutex );
+
+        for ( shared_function& f : functions )
+          m_functions.emplace_back( std::move( f ) );
+
+        functions.clear();
+      }
+
+      void pop( std::vector< shared_function >& functions )
+      {
+        const std::lock_guard< std::mutex > lock( m_mutex );
+        functions.swap( m_functions );
+      }
+
+    private:
+      std::mutex m_mutex;
+      std::vector< shared_function > m_functions;
+    };
+
+    template< std::size_t Size >
+    struct callable
+    {
+      bool operator()() const
+      {
+        return payload[ 0 ] == 0;
+      }
+
+      char payload[ Size ] = {};
+    };
+
+    class round
+    {
+    public:
+      round
+      ( const options& options, std::size_t creator_count,
+        std::size_t caller_count, std::size_t destroyer_count )
+        : m_options( options ),
+          m_creator_count( creator_count ),
+          m_caller_count( caller_count ),
+          m_destroyer_count( destroyer_count ),
+          m_slots( options.slot_count ),
+          m_queues( std::max< std::size_t >( destroyer_count, 1 ) ),
+          m_stop( false )
+      {
+        for ( std::atomic< weak_function >& slot : m_slots )
+          slot.store( weak_function(), std::memory_order_relaxed );
+      }
+
+      void run()
+      {
+        std::vector< thread_result > results
+          ( m_creator_count + m_caller_count + m_destroyer_count );
+        std::vector< std::thread > threads;
+        std::size_t r( 0 );
+
+        for ( std::size_t i( 0 ); i != m_creator_count; ++i, ++r )
+          threads.emplace_back( &round::create, this, i, &results[ r ] );
+
+        for ( std::size_t i( 0 ); i != m_caller_count; ++i, ++r )
+          threads.emplace_back( &round::call, this, i, &results[ r ] );
+
+        for ( std::size_t i( 0 ); i != m_destroyer_count; ++i, ++r )
+          threads.emplace_back( &round::destroy, this, i, &results[ r ] );
+
+        std::this_thread::sleep_for( m_options.duration );
+        m_stop.store( true );
+
+        for ( std::thread& t : threads )
+          t.join();
+
+        thread_result total;
+
+        for ( const thread_result& result : results )
+          {
+            total.allocate.merge( result.allocate );
+            total.call.merge( result.call );
+            total.release.merge( result.release );
+            total.expired_call_count += result.expired_call_count;
+          }
+
+        report( total );
+      }
+
+    private:
+      void create( std::size_t index, thread_result* result )
+      {
+        std::minstd_rand random( index + 1 );
+        std::uniform_int_distribution< std::size_t > slot
+          ( 0, m_slots.size() - 1 );
+        std::uniform_real_distribution< double > expire( 0, 1 );
+
+        std::deque< shared_function > live;
+        std::vector< shared_function > released;
+        release_queue& queue( m_queues[ index % m_queues.size() ] );
+
+        while ( !m_stop.load( std::memory_order_relaxed ) )
+          {
+            const clock::time_point start( clock::now() );
+            shared_function f( make_function() );
+            result->allocate.record( elapsed_since( start ) );
+
+            m_slots[ slot( random ) ].store
+              ( weak_function( f ), std::memory_order_release );
+
+            if ( expire( random ) < m_options.expired_ratio )
+              released.emplace_back( std::move( f ) );
+            else
+              {
+                live.emplace_back( std::move( f ) );
+
+                if ( live.size() == m_options.live_per_creator )
+                  {
+                    released.emplace_back( std::move( live.front() ) );
+                    live.pop_front();
+                  }
+              }
+
+            if ( released.size() >= 64 )
+              release( queue, released, *result );
+          }
+
+        for ( shared_function& f : live )
+          released.emplace_back( std::move( f ) );
+
+        release( queue, released, *result );
+      }
+
+      // Without destroyer the creators release the functions themselves.
+      void release
+      ( release_queue& queue, std::vector< shared_function >& functions,
+        thread_result& result )
+      {
+        if ( m_destroyer_count != 0 )
+          queue.push( functions );
+        else
+          destroy_all( functions, result );
+      }
+
+      void call( std::size_t index, thread_result* result )
+      {
+        std::minstd_rand random( 1000 + index );
+        std::uniform_int_distribution< std::size_t > slot
+          ( 0, m_slots.size() - 1 );
+
+        while ( !m_stop.load( std::memory_order_relaxed ) )
+          {
+            const weak_function f
+              ( m_slots[ slot( random ) ].load( std::memory_order_acquire ) );
+
+            const clock::time_point start( clock::now() );
+            const bool called( f().has_value() );
+            result->call.record( elapsed_since( start ) );
+
+            if ( !called )
+              ++result->expired_call_count;
+          }
+      }
+
+      void destroy( std::size_t index, thread_result* result )
+      {
+        std::vector< shared_function > functions;
+        bool stopped( false );
+
+        // The queue is emptied once more after the stop, to release the
+        // functions pushed by the creators on exit.
+        while ( true )
+          {
+            m_queues[ index ].pop( functions );
+
+            if ( functions.empty() )
+              {
+                if ( stopped )
+                  break;
+
+                stopped = m_stop.load( std::memory_order_relaxed );
+
+                if ( stopped )
+                  std::this_thread::sleep_for
+                    ( std::chrono::milliseconds( 10 ) );
+                else
+                  std::this_thread::yield();
+              }
+            else
+              destroy_all( functions, *result );
+          }
+      }
+
+      static void destroy_all
+      ( std::vector< shared_function >& functions, thread_result& result )
+      {
+        for ( shared_function& f : functions )
+          {
+            const clock::time_point start( clock::now() );
+            f.reset();
+            result.release.record( elapsed_since( start ) );
+          }
+
+        functions.clear();
+      }
+
+      shared_function make_function() const
+      {
+        switch ( m_options.callable_size )
+          {
+          case 16: return shared_function( callable< 16 >() );
+          case 64: return shared_function( callable< 64 >() );
+          case 256: return shared_function( callable< 256 >() );
+          default: return shared_function( callable< 1024 >() );
+          }
+      }
+
+      static std::uint64_t elapsed_since( clock::time_point start )
+      {
+        return std::chrono::duration_cast< std::chrono::nanoseconds >
+          ( clock::now() - start ).count();
+      }
+
+      void report( const thread_result& total ) const
+      {
+        const double seconds
+          ( std::chrono::duration< double >( m_options.duration ).count() );
+
+        std::printf
+          ( "creators=%zu callers=%zu destroyers=%zu expired calls=%.1f%%\n",
+            m_creator_count, m_caller_count, m_destroyer_count,
+            ( total.call.count() == 0 )
+            ? 0.
+            : 100. * total.expired_call_count / total.call.count() );
+
+        report( "allocate", total.allocate, seconds );
+        report( "call", total.call, seconds );
+        report( "release", total.release, seconds );
+      }
+
+      static void report
+      ( const char* operation, const histogram& h, double seconds )
+      {
+        std::printf
+          ( "  %-8s %12.0f op/s  p50=%6llu ns  p99=%6llu ns"
+            "  p99.9=%6llu ns\n",
+            operation, h.count() / seconds,
+            static_cast< unsigned long long >( h.percentile( 50 ) ),
+            static_cast< unsigned long long >( h.percentile( 99 ) ),
+            static_cast< unsigned long long >( h.percentile( 99.9 ) ) );
+      }
+
+    private:
+      const options& m_options;
+      const std::size_t m_creator_count;
+      const std::size_t m_caller_count;
+      const std::size_t m_destroyer_count;
+
+      std::vector< std::atomic< weak_function > > m_slots;
+      std::vector< release_queue > m_queues;
+      std::atomic< bool > m_stop;
+    };
+
+    static std::vector< std::size_t > parse_list( const char* s )
+    {
+      std::vector< std::size_t > result;
+
+      for ( char* end; *s != '\0'; s = end )
+        {
+          result.push_back( std::strtoul( s, &end, 10 ) );
+
+          if ( *end == ',' )
+            ++end;
+          else if ( *end != '\0' )
+            return std::vector< std::size_t >();
+        }
+
+      return result;
+    }
+
+    static bool parse_option( options& result, const std::string& arg )
+    {
+      const std::size_t equal( arg.find( '=' ) );
+
+      if ( ( arg.compare( 0, 2, "--" ) != 0 )
+           || ( equal == std::string::npos ) )
+        return false;
+
+      const std::string name( arg.substr( 2, equal - 2 ) );
+      const char* const value( arg.c_str() + equal + 1 );
+
+      if ( name == "creators" )
+        result.creators = parse_list( value );
+      else if ( name == "callers" )
+        result.callers = parse_list( value );
+      else if ( name == "destroyers" )
+        result.destroyers = parse_list( value );
+      else if ( name == "size" )
+        result.callable_size = std::strtoul( value, nullptr, 10 );
+      else if ( name == "expired" )
+        result.expired_ratio = std::strtod( value, nullptr );
+      else if ( name == "slots" )
+        result.slot_count = std::strtoul( value, nullptr, 10 );
+      else if ( name == "live" )
+        result.live_per_creator = std::strtoul( value, nullptr, 10 );
+      else if ( name == "duration" )
+        result.duration =
+          std::chrono::milliseconds( std::strtoul( value, nullptr, 10 ) );
+      else
+        return false;
+
+      return true;
+    }
+
+    // The thread count lists must have the same length, except the lists
+    // of a single value which are used in every round.
+    static std::size_t round_count( const options& options )
+    {
+      const std::size_t result
+        ( std::max
+          ( { options.creators.size(), options.callers.size(),
+              options.destroyers.size() } ) );
+
+      for ( const std::vector< std::size_t >* list
+              : { &options.creators, &options.callers, &options.destroyers } )
+        if ( list->empty()
+             || ( ( list->size() != 1 ) && ( list->size() != result ) ) )
+          return 0;
+
+      return result;
+    }
+
+    static std::size_t nth( const std::vector< std::size_t >& list,
+                            std::size_t i )
+    {
+      return list[ std::min( i, list.size() - 1 ) ];
+    }
+
+    static void usage( const char* program )
+    {
+      std::printf
+        ( "Usage: %s [options]\n"
+          "  --creators=N[,N...]    Threads creating the functions.\n"
+          "  --callers=N[,N...]     Threads calling the functions.\n"
+          "  --destroyers=N[,N...]  Threads releasing the functions.\n"
+          "  --size=16|64|256|1024  Size of the callables, in bytes.\n"
+          "  --expired=R            Ratio of the functions released right\n"
+          "                         after their creation.\n"
+          "  --slots=N              Number of weak functions to call.\n"
+          "  --live=N               Functions kept alive by each creator.\n"
+          "  --duration=MS          Duration of each round.\n"
+          "The lists of thread counts give one round per value.\n",
+          program );
+    }
+  }
+}
+
+int main( int argc, char* argv[] )
+{
+  wfl::stress::options options;
+
+  for ( int i( 1 ); i != argc; ++i )
+    if ( !wfl::stress::parse_option( options, argv[ i ] ) )
+      {
+        wfl::stress::usage( argv[ 0 ] );
+        return 1;
+      }
+
+  const std::size_t round_count( wfl::stress::round_count( options ) );
+
+  if ( ( round_count == 0 ) || ( options.slot_count == 0 )
+       || ( options.live_per_creator == 0 ) )
+    {
+      wfl::stress::usage( argv[ 0 ] );
+      return 1;
+    }
+
+  for ( std::size_t i( 0 ); i != round_count; ++i )
+    wfl::stress::round
+      ( options,
+        wfl::stress::nth( options.creators, i ),
+        wfl::stress::nth( options.callers, i ),
+        wfl::stress::nth( options.destroyers, i ) )
+      .run();
+
+  return 0;
+}
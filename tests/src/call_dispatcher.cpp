@@ -0,0 +1,197 @@
+#include "wfl/mt/call_dispatcher.hpp"
+#include "wfl/mt/shared_function.hpp"
+#include "wfl/mt/weak_function.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+TEST( wfl_call_dispatcher, repeated_posts_are_coalesced )
+{
+  int call_count( 0 );
+  const wfl::mt::shared_function< void() > shared
+    ( [ &call_count ]() -> void
+      {
+        ++call_count;
+      } );
+  const wfl::mt::weak_function< void() > weak( shared );
+
+  wfl::mt::call_dispatcher dispatcher;
+
+  for ( int i( 0 ); i != 100; ++i )
+    dispatcher.post( weak );
+
+  EXPECT_EQ( 0, call_count );
+  EXPECT_EQ( 1u, dispatcher.dispatch() );
+  EXPECT_EQ( 1, call_count );
+
+  EXPECT_EQ( 0u, dispatcher.dispatch() );
+  EXPECT_EQ( 1, call_count );
+}
+
+TEST( wfl_call_dispatcher, expired_functions_are_dropped )
+{
+  int call_count( 0 );
+  wfl::mt::weak_function< void() > weak;
+  wfl::mt::call_dispatcher dispatcher;
+
+  {
+    const wfl::mt::shared_function< void() > shared
+      ( [ &call_count ]() -> void
+        {
+          ++call_count;
+        } );
+    weak = shared;
+    dispatcher.post( weak );
+  }
+
+  dispatcher.post( wfl::mt::weak_function< void() >() );
+
+  EXPECT_EQ( 0u, dispatcher.dispatch() );
+  EXPECT_EQ( 0, call_count );
+}
+
+TEST( wfl_call_dispatcher, post_during_dispatch )
+{
+  wfl::mt::call_dispatcher dispatcher;
+  wfl::mt::weak_function< void() > weak;
+  int call_count( 0 );
+
+  const wfl::mt::shared_function< void() > shared
+    ( [ & ]() -> void
+      {
+        ++call_count;
+        dispatcher.post( weak );
+      } );
+  weak = shared;
+
+  dispatcher.post( weak );
+
+  EXPECT_EQ( 1u, dispatcher.dispatch() );
+  EXPECT_EQ( 1, call_count );
+  EXPECT_EQ( 1u, dispatcher.dispatch() );
+  EXPECT_EQ( 2, call_count );
+}
+
+TEST( wfl_call_dispatcher, posts_from_multiple_threads )
+{
+  constexpr int function_count( 16 );
+  constexpr int thread_count( 8 );
+
+  std::atomic< int > call_count( 0 );
+  std::vector< wfl::mt::shared_function< void() > > shared;
+  std::vector< wfl::mt::weak_function< void() > > weak;
+
+  for ( int i( 0 ); i != function_count; ++i )
+    {
+      shared.emplace_back
+        ( [ &call_count ]() -> void
+          {
+            ++call_count;
+          } );
+      weak.emplace_back( shared.back() );
+    }
+
+  wfl::mt::call_dispatcher dispatcher;
+  std::vector< std::thread > threads;
+
+  for ( int i( 0 ); i != thread_count; ++i )
+    threads.emplace_back
+      ( [ & ]() -> void
+        {
+          for ( int j( 0 ); j != 100; ++j )
+            for ( const wfl::mt::weak_function< void() >& w : weak )
+              dispatcher.post( w );
+        } );
+
+  std::size_t dispatched( 0 );
+
+  for ( int i( 0 ); i != 100; ++i )
+    dispatched += dispatcher.dispatch();
+
+  for ( std::thread& t : threads )
+    t.join();
+
+  dispatched += dispatcher.dispatch();
+
+  EXPECT_EQ( std::size_t( call_count.load() ), dispatched );
+  EXPECT_LE( function_count, call_count.load() );
+  EXPECT_GE( function_count * thread_count * 100, call_count.load() );
+}
+
+TEST( wfl_call_dispatcher, posts_see_the_writes_before_them )
+{
+  constexpr int round_count( 200 );
+  constexpr int post_count( 100 );
+
+  std::atomic< int > written( 0 );
+  int seen( 0 );
+  const wfl::mt::shared_function< void() > shared
+    ( [ & ]() -> void
+      {
+        seen = written.load( std::memory_order_relaxed );
+      } );
+  const wfl::mt::weak_function< void() > weak( shared );
+
+  wfl::mt::call_dispatcher dispatcher;
+
+  for ( int round( 0 ); round != round_count; ++round )
+    {
+      std::atomic< bool > done( false );
+      std::thread producer
+        ( [ & ]() -> void
+          {
+            for ( int i( 1 ); i <= post_count; ++i )
+              {
+                written.store
+                  ( round * post_count + i, std::memory_order_relaxed );
+                dispatcher.post( weak );
+              }
+
+            done.store( true, std::memory_order_release );
+          } );
+
+      while ( !done.load( std::memory_order_acquire ) )
+        dispatcher.dispatch();
+
+      // The last post happens-after the last write, thus a call must have
+      // seen this write, either in the loop above or in this dispatch.
+      dispatcher.dispatch();
+      producer.join();
+
+      ASSERT_EQ( ( round + 1 ) * post_count, seen );
+    }
+}
+
+TEST( wfl_call_dispatcher, many_functions )
+{
+  // More functions than the slots of the dispatcher, such that some of
+  // them are queued aside.
+  constexpr int function_count( 3000 );
+
+  int call_count( 0 );
+  std::vector< wfl::mt::shared_function< void() > > shared;
+  std::vector< wfl::mt::weak_function< void() > > weak;
+
+  for ( int i( 0 ); i != function_count; ++i )
+    {
+      shared.emplace_back
+        ( [ &call_count ]() -> void
+          {
+            ++call_count;
+          } );
+      weak.emplace_back( shared.back() );
+    }
+
+  wfl::mt::call_dispatcher dispatcher;
+
+  for ( int i( 0 ); i != 2; ++i )
+    for ( const wfl::mt::weak_function< void() >& w : weak )
+      dispatcher.post( w );
+
+  EXPECT_EQ( std::size_t( function_count ), dispatcher.dispatch() );
+  EXPECT_EQ( function_count, call_count );
+  EXPECT_EQ( 0u, dispatcher.dispatch() );
+}
@@ -0,0 +1,239 @@
+#include "wfl/callback_list.hpp"
+#include "wfl/shared_function.hpp"
+#include "wfl/weak_function.hpp"
+
+#include "wfl/mt/callback_list.hpp"
+#include "wfl/mt/shared_function.hpp"
+#include "wfl/mt/weak_function.hpp"
+
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+TEST( wfl_callback_list, call )
+{
+  int sum( 0 );
+  const wfl::shared_function< void( int ) > add
+    ( [ &sum ]( int value ) -> void
+      {
+        sum += value;
+      } );
+  const wfl::shared_function< void( int ) > add_twice
+    ( [ &sum ]( int value ) -> void
+      {
+        sum += 2 * value;
+      } );
+
+  wfl::callback_list< void( int ) > list;
+  EXPECT_TRUE( list.empty() );
+
+  list.add( add );
+  list.add( add_twice );
+  EXPECT_EQ( 2u, list.size() );
+
+  EXPECT_EQ( 2u, list( 10 ) );
+  EXPECT_EQ( 30, sum );
+}
+
+TEST( wfl_callback_list, expired_functions_are_removed )
+{
+  int call_count( 0 );
+  std::vector< std::unique_ptr< wfl::shared_function< void() > > > shared;
+  wfl::callback_list< void() > list;
+
+  for ( int i( 0 ); i != 10; ++i )
+    {
+      shared.emplace_back
+        ( new wfl::shared_function< void() >
+          ( [ &call_count ]() -> void
+            {
+              ++call_count;
+            } ) );
+      list.add( *shared.back() );
+    }
+
+  for ( int i( 0 ); i < 10; i += 2 )
+    shared[ i ].reset();
+
+  EXPECT_EQ( 10u, list.size() );
+  EXPECT_EQ( 5u, list() );
+  EXPECT_EQ( 5, call_count );
+  EXPECT_EQ( 5u, list.size() );
+
+  shared.clear();
+
+  EXPECT_EQ( 0u, list() );
+  EXPECT_TRUE( list.empty() );
+}
+
+TEST( wfl_callback_list, add_during_call )
+{
+  int call_count( 0 );
+  wfl::callback_list< void() > list;
+
+  const wfl::shared_function< void() > counter
+    ( [ &call_count ]() -> void
+      {
+        ++call_count;
+      } );
+  const wfl::shared_function< void() > adder
+    ( [ & ]() -> void
+      {
+        list.add( counter );
+      } );
+
+  list.add( adder );
+
+  EXPECT_EQ( 1u, list() );
+  EXPECT_EQ( 0, call_count );
+  EXPECT_EQ( 2u, list.size() );
+
+  EXPECT_EQ( 2u, list() );
+  EXPECT_EQ( 1, call_count );
+}
+
+TEST( wfl_callback_list, clear_during_call )
+{
+  wfl::callback_list< void() > list;
+
+  const wfl::shared_function< void() > clearer
+    ( [ &list ]() -> void
+      {
+        list.clear();
+      } );
+
+  list.add( clearer );
+  list.add( clearer );
+
+  list();
+  EXPECT_TRUE( list.empty() );
+}
+
+TEST( wfl_callback_list, clear_stops_the_call )
+{
+  wfl::callback_list< void() > list;
+  int call_count( 0 );
+
+  // The functions are called in the order of their storage, thus each of
+  // them clears the list, and only the first one is called.
+  const auto clear
+    ( [ &list, &call_count ]() -> void
+      {
+        ++call_count;
+        list.clear();
+      } );
+
+  const wfl::shared_function< void() > first( clear );
+  const wfl::shared_function< void() > second( clear );
+  const wfl::shared_function< void() > third( clear );
+
+  list.add( first );
+  list.add( second );
+  list.add( third );
+
+  EXPECT_EQ( 1u, list() );
+  EXPECT_EQ( 1, call_count );
+  EXPECT_TRUE( list.empty() );
+
+  // The functions added after the clear are kept for the next call.
+  const wfl::shared_function< void() > counter
+    ( [ &call_count ]() -> void
+      {
+        ++call_count;
+      } );
+  const wfl::shared_function< void() > refill
+    ( [ &list, &counter ]() -> void
+      {
+        list.clear();
+        list.add( counter );
+      } );
+
+  list.add( refill );
+  list();
+
+  EXPECT_EQ( 1u, list.size() );
+  EXPECT_EQ( 1u, list() );
+  EXPECT_EQ( 2, call_count );
+}
+
+TEST( wfl_callback_list, consistent_after_exception )
+{
+  bool throwing( true );
+  int call_count( 0 );
+  wfl::callback_list< void() > list;
+  std::unique_ptr< wfl::shared_function< void() > > expired
+    ( new wfl::shared_function< void() >
+      ( []() -> void
+        {
+        } ) );
+  const wfl::shared_function< void() > thrower
+    ( [ & ]() -> void
+      {
+        ++call_count;
+
+        if ( throwing )
+          throw std::runtime_error( "test" );
+      } );
+  const wfl::shared_function< void() > counter
+    ( [ &call_count ]() -> void
+      {
+        ++call_count;
+      } );
+
+  list.add( *expired );
+  list.add( thrower );
+  list.add( counter );
+  expired.reset();
+
+  EXPECT_THROW( list(), std::runtime_error );
+
+  // The live functions are still in the list, once.
+  throwing = false;
+  call_count = 0;
+
+  EXPECT_EQ( 2u, list() );
+  EXPECT_EQ( 2, call_count );
+  EXPECT_EQ( 2u, list.size() );
+}
+
+TEST( wfl_callback_list, recursive_call_throws )
+{
+  int call_count( 0 );
+  wfl::callback_list< void() > list;
+  const wfl::shared_function< void() > recursive
+    ( [ & ]() -> void
+      {
+        ++call_count;
+        EXPECT_THROW( list(), std::logic_error );
+      } );
+
+  list.add( recursive );
+
+  EXPECT_EQ( 1u, list() );
+  EXPECT_EQ( 1, call_count );
+  EXPECT_EQ( 1u, list.size() );
+}
+
+TEST( wfl_callback_list, thread_safe_functions )
+{
+  int call_count( 0 );
+  wfl::mt::callback_list< void() > list;
+
+  {
+    const wfl::mt::shared_function< void() > shared
+      ( [ &call_count ]() -> void
+        {
+          ++call_count;
+        } );
+    list.add( shared );
+    list.add( shared );
+
+    EXPECT_EQ( 2u, list() );
+    EXPECT_EQ( 2, call_count );
+  }
+
+  EXPECT_EQ( 0u, list() );
+  EXPECT_TRUE( list.empty() );
+}
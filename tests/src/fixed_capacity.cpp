@@ -0,0 +1,160 @@
+#include "wfl/fixed_function.hpp"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace wfl
+{
+  namespace test
+  {
+    typedef wfl::fixed_capacity_function_allocator< 4, 32 > fixed_allocator;
+
+    template< typename F >
+    using fixed_shared_function = wfl::fixed_shared_function< F, 4, 32 >;
+
+    template< typename F >
+    using fixed_weak_function = wfl::fixed_weak_function< F, 4, 32 >;
+  }
+}
+
+TEST( wfl_fixed_capacity, call )
+{
+  int call_count( 0 );
+
+  const wfl::test::fixed_shared_function< int( int ) > shared
+    ( [ &call_count ]( int i ) -> int
+      {
+        ++call_count;
+        return 2 * i;
+      } );
+  wfl::test::fixed_weak_function< int( int ) > weak( shared );
+
+  EXPECT_EQ( 4, shared( 2 ) );
+  EXPECT_EQ( 6, *weak( 3 ) );
+  EXPECT_EQ( 2, call_count );
+}
+
+TEST( wfl_fixed_capacity, try_reset_when_full )
+{
+  auto& allocator( wfl::test::fixed_allocator::instance() );
+  const std::size_t capacity( allocator.available_count() );
+  std::vector< wfl::test::fixed_shared_function< void() > > shared
+    ( capacity + 1 );
+  int call_count( 0 );
+
+  for ( std::size_t i( 0 ); i != capacity; ++i )
+    EXPECT_TRUE
+      ( shared[ i ].try_reset
+        ( [ &call_count ]() -> void
+          {
+            ++call_count;
+          } ) );
+
+  EXPECT_EQ( 0u, allocator.available_count() );
+  EXPECT_FALSE
+    ( shared[ capacity ].try_reset
+      ( []() -> void
+        {
+        } ) );
+
+  const wfl::test::fixed_weak_function< void() > weak( shared[ capacity ] );
+  weak();
+  EXPECT_TRUE( weak.expired() );
+
+  shared[ 0 ].reset();
+  EXPECT_EQ( 1u, allocator.available_count() );
+
+  EXPECT_TRUE
+    ( shared[ capacity ].try_reset
+      ( [ &call_count ]() -> void
+        {
+          call_count += 10;
+        } ) );
+
+  for ( std::size_t i( 1 ); i != shared.size(); ++i )
+    shared[ i ]();
+
+  EXPECT_EQ( int( capacity - 1 + 10 ), call_count );
+}
+
+TEST( wfl_fixed_capacity, allocate_throws_when_full )
+{
+  std::vector< wfl::test::fixed_shared_function< void() > > shared;
+  const auto f
+    ( []() -> void
+      {
+      } );
+
+  for ( std::size_t i( wfl::test::fixed_allocator::instance()
+                       .available_count() );
+        i != 0; --i )
+    shared.emplace_back( f );
+
+  EXPECT_THROW
+    ( wfl::test::fixed_shared_function< void() >{ f }, std::bad_alloc );
+}
+
+TEST( wfl_fixed_capacity, function_outliving_the_allocator_owner )
+{
+  const std::shared_ptr< int > counter( std::make_shared< int >( 0 ) );
+
+  std::thread thread
+    ( [ counter ]() -> void
+      {
+        typedef wfl::test::fixed_shared_function< void() > function_type;
+
+        // The holder is created before the allocator of the thread, thus
+        // it is destroyed after the end of the allocator's owner.
+        thread_local std::unique_ptr< function_type > holder;
+
+        holder.reset
+          ( new function_type
+            ( [ counter ]() -> void
+              {
+                ++*counter;
+              } ) );
+
+        ( *holder )();
+      } );
+  thread.join();
+
+  EXPECT_EQ( 1, *counter );
+  EXPECT_EQ( 1, counter.use_count() );
+}
+
+TEST( wfl_fixed_capacity, reset_into_full_allocator )
+{
+  auto& allocator( wfl::test::fixed_allocator::instance() );
+  const std::size_t capacity( allocator.available_count() );
+  int call_count( 0 );
+  const auto increment
+    ( [ &call_count ]() -> void
+      {
+        ++call_count;
+      } );
+
+  std::vector< wfl::test::fixed_shared_function< void() > > shared;
+
+  for ( std::size_t i( 0 ); i != capacity; ++i )
+    shared.emplace_back( increment );
+
+  {
+    // The copy keeps the block of the first function in use, thus its
+    // reset finds no room left.
+    wfl::test::fixed_shared_function< void() > copy( shared[ 0 ] );
+
+    EXPECT_THROW( copy.reset( increment ), std::bad_alloc );
+    EXPECT_FALSE( copy.try_reset( increment ) );
+  }
+
+  EXPECT_EQ( 0u, allocator.available_count() );
+
+  shared[ 0 ]();
+  EXPECT_EQ( 1, call_count );
+
+  shared.clear();
+  EXPECT_EQ( capacity, allocator.available_count() );
+}
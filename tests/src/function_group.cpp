@@ -0,0 +1,285 @@
+#include "wfl/mt/callback_list.hpp"
+#include "wfl/mt/function_group.hpp"
+#include "wfl/mt/shared_function.hpp"
+#include "wfl/mt/weak_function.hpp"
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+TEST( wfl_function_group, expire_all_functions )
+{
+  const std::shared_ptr< int > counter( std::make_shared< int >( 0 ) );
+  wfl::mt::function_group group;
+
+  const wfl::mt::weak_function< void() > increment
+    ( group.add< void() >
+      ( [ counter ]() -> void
+        {
+          ++*counter;
+        } ) );
+  const wfl::mt::weak_function< int( int ) > add
+    ( group.add< int( int ) >
+      ( [ counter ]( int v ) -> int
+        {
+          return *counter + v;
+        } ) );
+
+  EXPECT_EQ( 2u, group.size() );
+  EXPECT_EQ( 3, counter.use_count() );
+
+  increment();
+  EXPECT_EQ( 1, *counter );
+  EXPECT_EQ( 3, *add( 2 ) );
+
+  group.expire();
+
+  EXPECT_EQ( 0u, group.size() );
+  EXPECT_TRUE( increment.expired() );
+  EXPECT_TRUE( add.expired() );
+  EXPECT_EQ( 1, counter.use_count() );
+
+  increment();
+  EXPECT_EQ( 1, *counter );
+  EXPECT_FALSE( add( 2 ) );
+}
+
+TEST( wfl_function_group, destruction_expires_the_functions )
+{
+  const std::shared_ptr< int > counter( std::make_shared< int >( 0 ) );
+  wfl::mt::weak_function< void() > weak;
+
+  {
+    wfl::mt::function_group group;
+    weak =
+      group.add< void() >
+      ( [ counter ]() -> void
+        {
+          ++*counter;
+        } );
+
+    EXPECT_FALSE( weak.expired() );
+  }
+
+  EXPECT_TRUE( weak.expired() );
+  EXPECT_EQ( 1, counter.use_count() );
+}
+
+TEST( wfl_function_group, reuse_after_expire )
+{
+  wfl::mt::function_group group;
+  int old_calls( 0 );
+  int new_calls( 0 );
+
+  const wfl::mt::weak_function< void() > old_function
+    ( group.add< void() >
+      ( [ &old_calls ]() -> void
+        {
+          ++old_calls;
+        } ) );
+
+  group.expire();
+
+  // The new function reuses the block of the old one, with a new
+  // generation.
+  const wfl::mt::weak_function< void() > new_function
+    ( group.add< void() >
+      ( [ &new_calls ]() -> void
+        {
+          ++new_calls;
+        } ) );
+
+  old_function();
+  new_function();
+
+  EXPECT_TRUE( old_function.expired() );
+  EXPECT_FALSE( new_function.expired() );
+  EXPECT_EQ( 0, old_calls );
+  EXPECT_EQ( 1, new_calls );
+}
+
+TEST( wfl_function_group, large_callable )
+{
+  const std::shared_ptr< int > counter( std::make_shared< int >( 0 ) );
+  std::array< char, 200 > payload;
+  payload.fill( 1 );
+
+  wfl::mt::function_group group;
+  const wfl::mt::weak_function< int() > weak
+    ( group.add< int() >
+      ( [ counter, payload ]() -> int
+        {
+          return *counter + payload[ 199 ];
+        } ) );
+
+  EXPECT_EQ( 1, *weak() );
+
+  group.expire();
+
+  EXPECT_FALSE( weak() );
+  EXPECT_EQ( 1, counter.use_count() );
+}
+
+TEST( wfl_function_group, mixed_with_shared_functions )
+{
+  int call_count( 0 );
+  const auto increment
+    ( [ &call_count ]() -> void
+      {
+        ++call_count;
+      } );
+
+  wfl::mt::function_group group;
+  const wfl::mt::shared_function< void() > shared( increment );
+  wfl::mt::callback_list< void() > list;
+
+  list.add( group.add< void() >( increment ) );
+  list.add( shared );
+  list.add( group.add< void() >( increment ) );
+
+  list();
+  EXPECT_EQ( 3, call_count );
+
+  group.expire();
+
+  list();
+  EXPECT_EQ( 4, call_count );
+  EXPECT_EQ( 1u, list.size() );
+}
+
+TEST( wfl_function_group, full_group )
+{
+  constexpr std::size_t max_size( wfl::mt::function_group::max_size );
+
+  EXPECT_EQ( 256u, max_size );
+
+  wfl::mt::function_group group;
+  std::vector< wfl::mt::weak_function< void() > > functions;
+
+  for ( std::size_t i( 0 ); i != max_size; ++i )
+    functions.emplace_back( group.add< void() >( []() -> void {} ) );
+
+  EXPECT_THROW( group.add< void() >( []() -> void {} ), std::bad_alloc );
+
+  for ( const wfl::mt::weak_function< void() >& f : functions )
+    EXPECT_FALSE( f.expired() );
+
+  group.expire();
+
+  for ( const wfl::mt::weak_function< void() >& f : functions )
+    EXPECT_TRUE( f.expired() );
+}
+
+TEST( wfl_function_group, deferred_destruction_until_collect )
+{
+  wfl::detail::mt_function_allocator& allocator
+    ( wfl::detail::thread_safe_function_allocator::instance() );
+  const std::shared_ptr< int > counter( std::make_shared< int >( 0 ) );
+
+  allocator.defer_destruction( true );
+
+  wfl::mt::function_group group;
+  const wfl::mt::weak_function< void() > weak
+    ( group.add< void() >
+      ( [ counter ]() -> void
+        {
+          ++*counter;
+        } ) );
+
+  group.expire();
+
+  EXPECT_TRUE( weak.expired() );
+  EXPECT_EQ( 2, counter.use_count() );
+
+  allocator.collect();
+  EXPECT_EQ( 1, counter.use_count() );
+
+  allocator.defer_destruction( false );
+}
+
+TEST( wfl_function_group, trim_destroys_the_expired_groups )
+{
+  wfl::detail::mt_function_allocator& allocator
+    ( wfl::detail::thread_safe_function_allocator::instance() );
+  const std::shared_ptr< int > counter( std::make_shared< int >( 0 ) );
+
+  allocator.defer_destruction( true );
+
+  wfl::mt::function_group group;
+  group.add< void() >
+    ( [ counter ]() -> void
+      {
+        ++*counter;
+      } );
+  group.expire();
+
+  EXPECT_EQ( 2, counter.use_count() );
+
+  allocator.trim();
+  EXPECT_EQ( 1, counter.use_count() );
+
+  group.add< void() >
+    ( [ counter ]() -> void
+      {
+        ++*counter;
+      } );
+  group.expire();
+
+  allocator.shrink_to_fit();
+  EXPECT_EQ( 1, counter.use_count() );
+
+  allocator.defer_destruction( false );
+}
+
+TEST( wfl_function_group, expire_during_calls )
+{
+  constexpr int function_count( 32 );
+  std::atomic< bool > stop( false );
+  std::atomic< int > call_count( 0 );
+
+  wfl::mt::function_group group;
+  std::vector< wfl::mt::weak_function< int() > > functions;
+  const std::shared_ptr< int > value( std::make_shared< int >( 1 ) );
+
+  for ( int i( 0 ); i != function_count; ++i )
+    functions.emplace_back
+      ( group.add< int() >
+        ( [ value ]() -> int
+          {
+            return *value;
+          } ) );
+
+  std::thread caller
+    ( [ & ]() -> void
+      {
+        while ( !stop.load() )
+          for ( const wfl::mt::weak_function< int() >& f : functions )
+            {
+              const wfl::optional< int > result( f() );
+
+              if ( result )
+                {
+                  EXPECT_EQ( 1, *result );
+                  ++call_count;
+                }
+            }
+      } );
+
+  while ( call_count.load() == 0 )
+    std::this_thread::yield();
+
+  group.expire();
+  stop.store( true );
+  caller.join();
+
+  for ( const wfl::mt::weak_function< int() >& f : functions )
+    EXPECT_TRUE( f.expired() );
+
+  wfl::detail::thread_safe_function_allocator::instance().collect();
+  EXPECT_EQ( 1, value.use_count() );
+}
@@ -5,9 +5,13 @@
 #include "wfl/mt/shared_function.hpp"
 #include "wfl/mt/weak_function.hpp"
 
+#include "wfl/detail/background_collector.hpp"
+
 #include <atomic>
+#include <chrono>
 #include <memory>
 #include <mutex>
+#include <stdexcept>
 #include <thread>
 
 #include <gtest/gtest.h>
@@ -129,3 +133,487 @@ TEST( wfl_weak_function, weak_functions_from_multiple_threads )
   EXPECT_NE( 0, call_count.load() );
 }
 
+
+TEST( wfl_weak_function, calls_do_not_block_each_other )
+{
+  std::atomic< bool > second_called( false );
+  std::atomic< bool > second_called_during_first( false );
+  std::atomic< bool > first_started( false );
+
+  const wfl::mt::shared_function< void() > first
+    ( [ & ]() -> void
+      {
+        first_started = true;
+        
+        const std::chrono::steady_clock::time_point deadline
+          ( std::chrono::steady_clock::now() + std::chrono::seconds( 5 ) );
+
+        while ( !second_called
+                && ( std::chrono::steady_clock::now() < deadline ) )
+          std::this_thread::yield();
+
+        second_called_during_first = second_called.load();
+      } );
+  
+  const wfl::mt::shared_function< void() > second
+    ( [ & ]() -> void
+      {
+        second_called = true;
+      } );
+
+  const wfl::mt::weak_function< void() > weak_first( first );
+  const wfl::mt::weak_function< void() > weak_second( second );
+  
+  std::thread caller
+    ( [ & ]() -> void
+      {
+        weak_first();
+      } );
+
+  while ( !first_started )
+    std::this_thread::yield();
+  
+  weak_second();
+  caller.join();
+
+  EXPECT_TRUE( second_called_during_first );
+}
+
+TEST( wfl_weak_function, release_during_call_from_other_thread )
+{
+  std::shared_ptr< int > sentinel( std::make_shared< int >( 0 ) );
+  const std::weak_ptr< int > weak_sentinel( sentinel );
+  std::atomic< bool > call_started( false );
+  std::atomic< bool > shared_released( false );
+  std::atomic< bool > sentinel_alive_after_release( false );
+
+  std::unique_ptr< wfl::mt::shared_function< void() > > shared
+    ( new wfl::mt::shared_function< void() >
+      ( [ &, sentinel ]() -> void
+        {
+          call_started = true;
+
+          while ( !shared_released )
+            std::this_thread::yield();
+
+          sentinel_alive_after_release = !weak_sentinel.expired();
+        } ) );
+  sentinel.reset();
+  
+  const wfl::mt::weak_function< void() > weak( *shared );
+  
+  std::thread caller
+    ( [ & ]() -> void
+      {
+        weak();
+      } );
+
+  while ( !call_started )
+    std::this_thread::yield();
+
+  shared.reset();
+  shared_released = true;
+  
+  caller.join();
+
+  EXPECT_TRUE( sentinel_alive_after_release );
+  EXPECT_TRUE( weak_sentinel.expired() );
+
+  int call_count( 0 );
+  const wfl::mt::shared_function< void() > other
+    ( [ & ]() -> void
+      {
+        ++call_count;
+      } );
+
+  weak();
+  EXPECT_EQ( 0, call_count );
+}
+
+TEST( wfl_weak_function, shared_functions_from_many_threads )
+{
+  std::vector< std::unique_ptr< wfl::mt::shared_function< void() > > > shared;
+  std::mutex mutex;
+  std::atomic< int > call_count( 0 );
+  
+  const auto increment
+    ( [ & ]() -> void
+      {
+        ++call_count;
+      } );
+
+  constexpr int thread_count( 40 );
+  constexpr int function_count( 100 );
+  std::vector< std::thread > threads;
+
+  for ( int i( 0 ); i != thread_count; ++i )
+    threads.emplace_back
+      ( [ & ]() -> void
+        {
+          for ( int j( 0 ); j != function_count; ++j )
+            {
+              std::unique_ptr< wfl::mt::shared_function< void() > > f
+                ( new wfl::mt::shared_function< void() >( increment ) );
+              
+              const std::lock_guard< std::mutex > lock( mutex );
+              shared.emplace_back( std::move( f ) );
+            }
+        } );
+
+  for ( std::thread& t : threads )
+    t.join();
+
+  std::vector< wfl::mt::weak_function< void() > > weak;
+  weak.reserve( shared.size() );
+
+  for ( const auto& f : shared )
+    weak.emplace_back( *f );
+
+  for ( const auto& f : weak )
+    f();
+
+  EXPECT_EQ( thread_count * function_count, call_count.load() );
+
+  threads.clear();
+  
+  for ( int i( 0 ); i != thread_count; ++i )
+    threads.emplace_back
+      ( [ &, i ]() -> void
+        {
+          for ( int j( 0 ); j != function_count; ++j )
+            shared[ i * function_count + j ].reset();
+        } );
+
+  for ( std::thread& t : threads )
+    t.join();
+
+  for ( const auto& f : weak )
+    f();
+
+  EXPECT_EQ( thread_count * function_count, call_count.load() );
+}
+
+TEST( wfl_weak_function, released_function_is_destroyed_on_release )
+{
+  std::shared_ptr< int > sentinel( std::make_shared< int >( 0 ) );
+  const std::weak_ptr< int > weak_sentinel( sentinel );
+
+  std::unique_ptr< wfl::mt::shared_function< void() > > shared
+    ( new wfl::mt::shared_function< void() >
+      ( [ sentinel ]() -> void
+        {
+        } ) );
+  sentinel.reset();
+
+  const wfl::mt::weak_function< void() > weak( *shared );
+
+  // No thread is calling the function, thus the release destroys it
+  // without waiting for another allocation.
+  shared.reset();
+
+  EXPECT_TRUE( weak_sentinel.expired() );
+  EXPECT_TRUE( weak.expired() );
+}
+
+TEST( wfl_weak_function, deferred_destruction_until_collect )
+{
+  wfl::detail::mt_function_allocator& allocator
+    ( wfl::detail::thread_safe_function_allocator::instance() );
+  allocator.defer_destruction( true );
+
+  std::shared_ptr< int > sentinel( std::make_shared< int >( 0 ) );
+  const std::weak_ptr< int > weak_sentinel( sentinel );
+
+  std::unique_ptr< wfl::mt::shared_function< void() > > shared
+    ( new wfl::mt::shared_function< void() >
+      ( [ sentinel ]() -> void
+        {
+        } ) );
+  sentinel.reset();
+
+  const wfl::mt::weak_function< void() > weak( *shared );
+  shared.reset();
+
+  // Neither the next allocation nor a call destroys the function.
+  const wfl::mt::shared_function< void() > other
+    ( []() -> void
+      {
+      } );
+  other();
+  weak();
+
+  EXPECT_TRUE( weak.expired() );
+  EXPECT_FALSE( weak_sentinel.expired() );
+
+  allocator.collect();
+  EXPECT_TRUE( weak_sentinel.expired() );
+
+  allocator.defer_destruction( false );
+}
+
+TEST( wfl_weak_function, background_collector )
+{
+  std::shared_ptr< int > sentinel( std::make_shared< int >( 0 ) );
+  const std::weak_ptr< int > weak_sentinel( sentinel );
+
+  const wfl::detail::background_collector collector
+    ( std::chrono::milliseconds( 1 ) );
+
+  {
+    const wfl::mt::shared_function< void() > shared
+      ( [ sentinel ]() -> void
+        {
+        } );
+    sentinel.reset();
+  }
+
+  for ( int i( 0 ); ( i != 1000 ) && !weak_sentinel.expired(); ++i )
+    std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+
+  EXPECT_TRUE( weak_sentinel.expired() );
+}
+
+TEST( wfl_weak_function, expired_after_shrink_to_fit )
+{
+  wfl::detail::mt_function_allocator& allocator
+    ( wfl::detail::thread_safe_function_allocator::instance() );
+  allocator.reserve( 1000, sizeof( int* ) );
+
+  std::atomic< int > call_count( 0 );
+  std::vector< wfl::mt::weak_function< void() > > weak;
+
+  {
+    std::vector< wfl::mt::shared_function< void() > > shared;
+
+    for ( int i( 0 ); i != 1000; ++i )
+      {
+        shared.emplace_back
+          ( [ &call_count ]() -> void
+            {
+              ++call_count;
+            } );
+        weak.emplace_back( shared.back() );
+      }
+  }
+
+  const std::size_t page_count( allocator.statistics().page_count );
+
+  allocator.shrink_to_fit();
+
+  // The functions of the other tests may keep some pages alive, but not the
+  // ones of the thousand blocks released above.
+  EXPECT_LT( allocator.statistics().page_count, page_count );
+
+  std::vector< wfl::mt::shared_function< void() > > shared;
+
+  for ( int i( 0 ); i != 1000; ++i )
+    shared.emplace_back
+      ( [ &call_count ]() -> void
+        {
+          ++call_count;
+        } );
+
+  for ( const wfl::mt::weak_function< void() >& w : weak )
+    {
+      EXPECT_TRUE( w.expired() );
+      w();
+    }
+
+  EXPECT_EQ( 0, call_count.load() );
+
+  for ( const wfl::mt::shared_function< void() >& f : shared )
+    f();
+
+  EXPECT_EQ( 1000, call_count.load() );
+}
+
+TEST( wfl_weak_function, statistics_from_multiple_threads )
+{
+  wfl::detail::mt_function_allocator& allocator
+    ( wfl::detail::thread_safe_function_allocator::instance() );
+  const wfl::detail::allocator_statistics before( allocator.statistics() );
+
+  constexpr int thread_count( 8 );
+  std::vector< std::thread > threads;
+
+  for ( int i( 0 ); i != thread_count; ++i )
+    threads.emplace_back
+      ( []() -> void
+        {
+          wfl::mt::weak_function< void() > weak;
+
+          {
+            const wfl::mt::shared_function< void() > shared
+              ( []() -> void
+                {
+                } );
+            weak = shared;
+            weak();
+          }
+
+          weak();
+        } );
+
+  for ( std::thread& t : threads )
+    t.join();
+
+  const wfl::detail::allocator_statistics after( allocator.statistics() );
+
+  EXPECT_EQ
+    ( before.allocation_count + thread_count, after.allocation_count );
+  EXPECT_EQ( before.call_count + thread_count, after.call_count );
+  EXPECT_EQ
+    ( before.expired_call_count + thread_count, after.expired_call_count );
+  EXPECT_LE( after.release_count, after.allocation_count );
+}
+
+TEST( wfl_weak_function, handle_is_lock_free )
+{
+  const std::atomic< wfl::mt::weak_function< void() > > weak{};
+  EXPECT_TRUE( weak.is_lock_free() );
+}
+
+TEST( wfl_weak_function, call_all_from_multiple_threads )
+{
+  constexpr int thread_count( 8 );
+  constexpr int function_count( 100 );
+  std::atomic< int > call_count( 0 );
+  std::vector< std::unique_ptr< wfl::mt::shared_function< void( int ) > > >
+    shared( thread_count * function_count );
+  std::vector< std::thread > threads;
+
+  for ( int i( 0 ); i != thread_count; ++i )
+    threads.emplace_back
+      ( [ &, i ]() -> void
+        {
+          for ( int j( 0 ); j != function_count; ++j )
+            shared[ i * function_count + j ].reset
+              ( new wfl::mt::shared_function< void( int ) >
+                ( [ & ]( int value ) -> void
+                  {
+                    call_count += value;
+                  } ) );
+        } );
+
+  for ( std::thread& t : threads )
+    t.join();
+
+  std::vector< wfl::mt::weak_function< void( int ) > > weak;
+
+  for ( const auto& f : shared )
+    weak.emplace_back( *f );
+
+  for ( std::size_t i( 0 ); i < shared.size(); i += 4 )
+    shared[ i ].reset();
+
+  EXPECT_EQ
+    ( std::size_t( 3 * thread_count * function_count / 4 ),
+      wfl::mt::weak_function< void( int ) >::call_all
+      ( weak.begin(), weak.end(), 1 ) );
+  EXPECT_EQ( 3 * thread_count * function_count / 4, call_count.load() );
+}
+
+TEST( wfl_weak_function, call_all_does_not_delay_reclamation )
+{
+  std::shared_ptr< int > sentinel( std::make_shared< int >( 0 ) );
+  const std::weak_ptr< int > weak_sentinel( sentinel );
+
+  std::unique_ptr< wfl::mt::shared_function< void() > > released
+    ( new wfl::mt::shared_function< void() >
+      ( [ sentinel ]() -> void
+        {
+        } ) );
+  sentinel.reset();
+
+  int call_count( 0 );
+  bool expired_during_call( false );
+
+  const auto release_then_collect
+    ( [ & ]() -> void
+      {
+        if ( call_count++ == 0 )
+          {
+            released.reset();
+            return;
+          }
+
+        // The function released by the previous call can be destroyed
+        // while the batch is still running.
+        std::thread collector
+          ( []() -> void
+            {
+              wfl::detail::thread_safe_function_allocator::instance()
+                .collect();
+            } );
+        collector.join();
+
+        expired_during_call = weak_sentinel.expired();
+      } );
+
+  const wfl::mt::shared_function< void() > first( release_then_collect );
+  const wfl::mt::shared_function< void() > second( release_then_collect );
+  const std::vector< wfl::mt::weak_function< void() > > weak
+    { first, second };
+
+  EXPECT_EQ
+    ( 2u,
+      wfl::mt::weak_function< void() >::call_all( weak.begin(), weak.end() ) );
+  EXPECT_TRUE( expired_during_call );
+}
+
+TEST( wfl_weak_function, result_from_other_thread )
+{
+  const wfl::mt::shared_function< int() > shared
+    ( []() -> int
+      {
+        return 42;
+      } );
+  const wfl::mt::weak_function< int() > weak( shared );
+  wfl::optional< int > result;
+
+  std::thread caller
+    ( [ & ]() -> void
+      {
+        result = weak();
+      } );
+  caller.join();
+
+  ASSERT_TRUE( result.has_value() );
+  EXPECT_EQ( 42, *result );
+}
+
+TEST( wfl_weak_function, throwing_construction_in_thread_safe_storage )
+{
+  struct throwing_copy
+  {
+    throwing_copy() = default;
+
+    throwing_copy( const throwing_copy& )
+    {
+      throw std::runtime_error( "copy" );
+    }
+
+    void operator()() const
+    {
+
+    }
+  };
+
+  wfl::detail::mt_function_allocator& allocator
+    ( wfl::detail::thread_safe_function_allocator::instance() );
+
+  // The blocks released by the previous tests must not be reclaimed by the
+  // allocation below.
+  allocator.collect();
+
+  const wfl::detail::allocator_statistics before( allocator.statistics() );
+  const throwing_copy f;
+
+  EXPECT_THROW
+    ( wfl::mt::shared_function< void() >{ f }, std::runtime_error );
+
+  const wfl::detail::allocator_statistics after( allocator.statistics() );
+
+  EXPECT_EQ( before.live_count, after.live_count );
+  EXPECT_EQ( before.release_count + 1, after.release_count );
+}
@@ -1,4 +1,14 @@
+#include "wfl/memory_resource.hpp"
+#include "wfl/detail/mt_function_allocator_storage.hpp"
 #include "wfl/shared_function.hpp"
+#include "wfl/weak_function.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -12,6 +22,62 @@ namespace wfl
     {
       ++shared_function_call_count;
     }
+
+    struct copy_counter
+    {
+      explicit copy_counter( int& copies )
+        : copies( copies )
+      {
+
+      }
+
+      copy_counter( const copy_counter& that )
+        : copies( that.copies )
+      {
+        ++copies;
+      }
+
+      copy_counter( copy_counter&& that ) = default;
+
+      int& copies;
+    };
+
+    struct throwing_copy
+    {
+      throwing_copy() = default;
+
+      throwing_copy( const throwing_copy& )
+      {
+        throw std::runtime_error( "copy" );
+      }
+
+      void operator()() const
+      {
+
+      }
+    };
+
+    class counting_resource:
+      public memory_resource
+    {
+    public:
+      std::size_t allocated = 0;
+      std::size_t deallocated = 0;
+
+    private:
+      void* do_allocate( std::size_t bytes, std::size_t alignment ) override
+      {
+        allocated += bytes;
+        return new_delete_resource()->allocate( bytes, alignment );
+      }
+
+      void do_deallocate
+      ( void* p, std::size_t bytes, std::size_t alignment ) override
+      {
+        deallocated += bytes;
+        new_delete_resource()->deallocate( p, bytes, alignment );
+      }
+    };
   }
 }
 
@@ -142,3 +208,490 @@ TEST( wfl_shared_function, argument )
   shared( value );
   EXPECT_EQ( value, argument_value );
 }
+
+TEST( wfl_shared_function, shared_from_large_lambda )
+{
+  int call_count( 0 );
+  char payload[ 2 * wfl::detail::size_classes::largest ] = { 1 };
+  
+  const wfl::shared_function< void() > shared
+    ( [ &, payload ]() -> void
+      {
+        call_count += payload[ 0 ];
+      } );
+
+  EXPECT_EQ( 0, call_count );
+    
+  shared();
+  EXPECT_EQ( 1, call_count );
+}
+
+TEST( wfl_shared_function, callable_is_destroyed )
+{
+  std::shared_ptr< int > small( std::make_shared< int >( 0 ) );
+  std::shared_ptr< int > large( std::make_shared< int >( 0 ) );
+  const std::weak_ptr< int > weak_small( small );
+  const std::weak_ptr< int > weak_large( large );
+  char payload[ 2 * wfl::detail::size_classes::largest ] = {};
+
+  {
+    const wfl::shared_function< void() > shared_small
+      ( [ small ]() -> void
+        {
+        } );
+    const wfl::shared_function< void() > shared_large
+      ( [ large, payload ]() -> void
+        {
+        } );
+
+    small.reset();
+    large.reset();
+
+    EXPECT_FALSE( weak_small.expired() );
+    EXPECT_FALSE( weak_large.expired() );
+  }
+
+  EXPECT_TRUE( weak_small.expired() );
+  EXPECT_TRUE( weak_large.expired() );
+}
+
+TEST( wfl_shared_function, size_classes )
+{
+  typedef wfl::detail::size_classes size_classes;
+
+  // The expected classes depend on WFL_INLINE_CALLABLE_SIZE, thus they are
+  // computed from the sizes of the classes.
+  EXPECT_EQ( 0u, size_classes::of< void* >::value );
+  EXPECT_EQ
+    ( size_classes::index_of( size_classes::size( 2 ) ),
+      size_classes::of< char[ size_classes::size( 2 ) ] >::value );
+  EXPECT_EQ
+    ( size_classes::index_of( size_classes::size( 2 ) + 1 ),
+      size_classes::of< char[ size_classes::size( 2 ) + 1 ] >::value );
+  EXPECT_EQ
+    ( size_classes::count - 1,
+      size_classes::of< char[ size_classes::largest ] >::value );
+  EXPECT_EQ
+    ( 0u, size_classes::of< char[ size_classes::largest + 1 ] >::value );
+
+  for ( std::size_t i( 1 ); i != size_classes::count; ++i )
+    EXPECT_LE( size_classes::size( i - 1 ), size_classes::size( i ) );
+}
+
+TEST( wfl_shared_function, default_size_classes )
+{
+  typedef wfl::detail::size_classes size_classes;
+
+  if ( size_classes::largest != 256 )
+    return;
+
+  EXPECT_EQ( 1u, size_classes::of< char[ 24 ] >::value );
+  EXPECT_EQ( 2u, size_classes::of< char[ 64 ] >::value );
+  EXPECT_EQ( 3u, size_classes::of< char[ 65 ] >::value );
+  EXPECT_EQ( 4u, size_classes::of< char[ 200 ] >::value );
+  EXPECT_EQ( 0u, size_classes::of< char[ 300 ] >::value );
+}
+
+TEST( wfl_shared_function, shared_of_each_size_class )
+{
+  int sum( 0 );
+  char small[ 8 ] = { 1 };
+  char medium[ 60 ] = { 2 };
+  char large[ 200 ] = { 3 };
+  char huge[ 300 ] = { 4 };
+
+  const wfl::shared_function< void() > shared_small
+    ( [ &, small ]() -> void
+      {
+        sum += small[ 0 ];
+      } );
+  const wfl::shared_function< void() > shared_medium
+    ( [ &, medium ]() -> void
+      {
+        sum += medium[ 0 ];
+      } );
+  const wfl::shared_function< void() > shared_large
+    ( [ &, large ]() -> void
+      {
+        sum += large[ 0 ];
+      } );
+  const wfl::shared_function< void() > shared_huge
+    ( [ &, huge ]() -> void
+      {
+        sum += huge[ 0 ];
+      } );
+
+  shared_small();
+  EXPECT_EQ( 1, sum );
+
+  shared_medium();
+  EXPECT_EQ( 3, sum );
+
+  shared_large();
+  EXPECT_EQ( 6, sum );
+
+  shared_huge();
+  EXPECT_EQ( 10, sum );
+}
+
+TEST( wfl_shared_function, many_copies )
+{
+  int call_count( 0 );
+  std::unique_ptr< wfl::shared_function< void() > > shared
+    ( new wfl::shared_function< void() >
+      ( [ & ]() -> void
+        {
+          ++call_count;
+        } ) );
+
+  std::vector< wfl::shared_function< void() > > copies( 1000, *shared );
+  shared.reset();
+
+  copies.back()();
+  EXPECT_EQ( 1, call_count );
+
+  copies.resize( 1 );
+  copies.back()();
+  EXPECT_EQ( 2, call_count );
+}
+
+TEST( wfl_shared_function, arguments_are_not_copied )
+{
+  int copies( 0 );
+  wfl::test::copy_counter counter( copies );
+
+  const wfl::shared_function< void( wfl::test::copy_counter ) > by_value
+    ( []( wfl::test::copy_counter ) -> void
+      {
+      } );
+
+  by_value( wfl::test::copy_counter( copies ) );
+  EXPECT_EQ( 0, copies );
+
+  by_value( counter );
+  EXPECT_EQ( 1, copies );
+
+  const wfl::shared_function< void( const wfl::test::copy_counter& ) >
+    by_reference
+    ( []( const wfl::test::copy_counter& ) -> void
+      {
+      } );
+
+  copies = 0;
+  by_reference( counter );
+  EXPECT_EQ( 0, copies );
+}
+
+TEST( wfl_shared_function, callable_is_not_copied )
+{
+  int copies( 0 );
+  wfl::test::copy_counter counter( copies );
+
+  const wfl::shared_function< void() > shared
+    ( [ counter ]() -> void
+      {
+      } );
+
+  EXPECT_EQ( 1, copies );
+}
+
+TEST( wfl_shared_function, move )
+{
+  int call_count( 0 );
+
+  wfl::shared_function< void() > shared
+    ( [ & ]() -> void
+      {
+        ++call_count;
+      } );
+
+  wfl::shared_function< void() > moved( std::move( shared ) );
+  moved();
+  EXPECT_EQ( 1, call_count );
+
+  wfl::shared_function< void() > assigned;
+  assigned = std::move( moved );
+  assigned();
+  EXPECT_EQ( 2, call_count );
+
+  shared = std::move( assigned );
+  shared();
+  EXPECT_EQ( 3, call_count );
+}
+
+TEST( wfl_shared_function, result )
+{
+  const wfl::shared_function< std::string( std::string, int ) > shared
+    ( []( std::string s, int i ) -> std::string
+      {
+        std::string result;
+
+        for ( ; i > 0; --i )
+          result += s;
+
+        return result;
+      } );
+
+  EXPECT_EQ( "", shared( "ab", 0 ) );
+  EXPECT_EQ( "abab", shared( "ab", 2 ) );
+}
+
+TEST( wfl_shared_function, released_from_other_thread )
+{
+  std::shared_ptr< int > counter( std::make_shared< int >( 0 ) );
+  const std::weak_ptr< int > weak_counter( counter );
+
+  std::unique_ptr< wfl::shared_function< void() > > shared
+    ( new wfl::shared_function< void() >
+      ( [ counter ]() -> void
+        {
+          ++*counter;
+        } ) );
+  counter.reset();
+
+  std::thread releaser
+    ( [ & ]() -> void
+      {
+        shared.reset();
+      } );
+  releaser.join();
+
+  // The release is applied by the owner on its next allocation.
+  const wfl::shared_function< void() > other
+    ( []() -> void
+      {
+      } );
+
+  EXPECT_TRUE( weak_counter.expired() );
+}
+
+TEST( wfl_shared_function, released_after_owner_exit )
+{
+  std::shared_ptr< int > counter( std::make_shared< int >( 0 ) );
+  const std::weak_ptr< int > weak_counter( counter );
+  std::unique_ptr< wfl::shared_function< void() > > shared;
+
+  std::thread owner
+    ( [ & ]() -> void
+      {
+        shared.reset
+          ( new wfl::shared_function< void() >
+            ( [ counter ]() -> void
+              {
+                ++*counter;
+              } ) );
+        counter.reset();
+      } );
+  owner.join();
+
+  EXPECT_FALSE( weak_counter.expired() );
+
+  shared.reset();
+  EXPECT_TRUE( weak_counter.expired() );
+}
+
+TEST( wfl_shared_function, released_after_many_owners_exit )
+{
+  // More owners than the former limit of the allocators, all abandoned with
+  // a live function.
+  constexpr int thread_count( 1100 );
+
+  const std::shared_ptr< int > counter( std::make_shared< int >( 0 ) );
+  std::vector< wfl::shared_function< void() > > shared;
+  shared.reserve( thread_count );
+
+  for ( int i( 0 ); i != thread_count; ++i )
+    {
+      std::thread owner
+        ( [ & ]() -> void
+          {
+            shared.emplace_back
+              ( [ counter ]() -> void
+                {
+                  ++*counter;
+                } );
+          } );
+      owner.join();
+    }
+
+  EXPECT_EQ( thread_count + 1, counter.use_count() );
+
+  shared.clear();
+  EXPECT_EQ( 1, counter.use_count() );
+}
+
+TEST( wfl_shared_function, released_concurrently_after_owner_exit )
+{
+  constexpr int thread_count( 8 );
+  constexpr int function_count( 1000 );
+
+  const std::shared_ptr< int > counter( std::make_shared< int >( 0 ) );
+  std::vector< wfl::shared_function< void() > > shared;
+
+  std::thread owner
+    ( [ & ]() -> void
+      {
+        for ( int i( 0 ); i != function_count; ++i )
+          shared.emplace_back
+            ( [ counter ]() -> void
+              {
+                ++*counter;
+              } );
+      } );
+  owner.join();
+
+  // The abandoned allocator receives the releases of several threads at
+  // once, and is deleted by the one releasing its last function.
+  std::vector< std::thread > releasers;
+
+  for ( int t( 0 ); t != thread_count; ++t )
+    releasers.emplace_back
+      ( [ &, t ]() -> void
+        {
+          for ( int i( t ); i < function_count; i += thread_count )
+            shared[ i ].reset();
+        } );
+
+  for ( std::thread& t : releasers )
+    t.join();
+
+  EXPECT_EQ( 1, counter.use_count() );
+}
+
+TEST( wfl_shared_function, use_from_other_thread )
+{
+  int call_count( 0 );
+  const wfl::shared_function< void() > shared
+    ( [ &call_count ]() -> void
+      {
+        ++call_count;
+      } );
+  const wfl::weak_function< void() > weak( shared );
+
+  std::thread other
+    ( [ & ]() -> void
+      {
+        // The function of another thread is seen as expired, and cannot
+        // be copied or called directly.
+        EXPECT_TRUE( weak.expired() );
+        weak();
+
+        EXPECT_THROW
+          ( wfl::shared_function< void() >{ shared }, std::logic_error );
+        EXPECT_THROW( shared(), std::logic_error );
+      } );
+  other.join();
+
+  EXPECT_EQ( 0, call_count );
+  EXPECT_FALSE( weak.expired() );
+}
+
+TEST( wfl_shared_function, memory_from_default_resource )
+{
+  wfl::test::counting_resource resource;
+  wfl::memory_resource* const previous
+    ( wfl::set_default_resource( &resource ) );
+
+  // The allocator of a new thread uses the resource.
+  std::thread thread
+    ( [ &resource ]() -> void
+      {
+        const wfl::shared_function< void() > small
+          ( []() -> void
+            {
+            } );
+
+        const std::size_t storage_bytes( resource.allocated );
+        EXPECT_NE( 0u, storage_bytes );
+
+        char payload[ 2 * wfl::detail::size_classes::largest ] = {};
+
+        {
+          const wfl::shared_function< void() > large
+            ( [ payload ]() -> void
+              {
+              } );
+
+          EXPECT_LE( storage_bytes + sizeof( payload ), resource.allocated );
+        }
+
+        EXPECT_LE( sizeof( payload ), resource.deallocated );
+      } );
+  thread.join();
+
+  EXPECT_EQ( &resource, wfl::set_default_resource( previous ) );
+  EXPECT_EQ( resource.allocated, resource.deallocated );
+}
+
+TEST( wfl_shared_function, thread_safe_storage_from_default_resource )
+{
+  wfl::test::counting_resource resource;
+  wfl::memory_resource* const previous
+    ( wfl::set_default_resource( &resource ) );
+
+  {
+    wfl::detail::mt_function_allocator_storage< 32 > storage;
+    const wfl::detail::mt_function_allocator_storage< 32 >::allocation_result
+      result( storage.allocate() );
+
+    result.storage->construct< void() >( []() -> void {}, resource );
+
+    const std::size_t page_bytes( resource.allocated );
+    EXPECT_NE( 0u, page_bytes );
+
+    // The retired and available blocks are tracked in containers using the
+    // resource too.
+    storage.release_one( result.handle );
+    storage.collect();
+
+    EXPECT_LT( page_bytes, resource.allocated );
+  }
+
+  EXPECT_EQ( &resource, wfl::set_default_resource( previous ) );
+  EXPECT_EQ( resource.allocated, resource.deallocated );
+}
+
+TEST( wfl_shared_function, new_delete_resource_alignment )
+{
+  wfl::memory_resource& resource( *wfl::new_delete_resource() );
+
+  for ( std::size_t alignment( 1 ); alignment <= 4096; alignment *= 2 )
+    {
+      void* const p( resource.allocate( 100, alignment ) );
+
+      EXPECT_EQ
+        ( 0u, reinterpret_cast< std::uintptr_t >( p ) & ( alignment - 1 ) );
+
+      resource.deallocate( p, 100, alignment );
+    }
+}
+
+TEST( wfl_shared_function, throwing_construction_gives_the_block_back )
+{
+  std::thread thread
+    ( []() -> void
+      {
+        wfl::detail::function_allocator& allocator
+          ( wfl::detail::thread_local_function_allocator::instance() );
+        const wfl::test::throwing_copy f;
+
+        EXPECT_THROW
+          ( wfl::shared_function< void() >{ f }, std::runtime_error );
+
+        const wfl::detail::allocator_statistics statistics
+          ( allocator.statistics() );
+
+        EXPECT_EQ( 0u, statistics.live_count );
+        EXPECT_EQ( 1u, statistics.available_count );
+
+        const wfl::shared_function< void() > shared
+          ( []() -> void
+            {
+            } );
+
+        EXPECT_EQ( 1u, allocator.statistics().live_count );
+        EXPECT_EQ( 0u, allocator.statistics().available_count );
+      } );
+
+  thread.join();
+}
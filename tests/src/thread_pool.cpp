@@ -0,0 +1,142 @@
+#include "wfl/mt/thread_pool.hpp"
+#include "wfl/mt/shared_function.hpp"
+#include "wfl/mt/weak_function.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+TEST( wfl_thread_pool, run )
+{
+  std::atomic< int > call_count( 0 );
+  const wfl::mt::shared_function< void() > shared
+    ( [ &call_count ]() -> void
+      {
+        ++call_count;
+      } );
+
+  std::uint64_t run_count;
+
+  {
+    wfl::mt::thread_pool pool( 4 );
+
+    for ( int i( 0 ); i != 1000; ++i )
+      pool.submit( shared );
+
+    while ( pool.run_count() != 1000 )
+      std::this_thread::yield();
+
+    run_count = pool.run_count();
+  }
+
+  EXPECT_EQ( 1000u, run_count );
+  EXPECT_EQ( 1000, call_count.load() );
+}
+
+TEST( wfl_thread_pool, expired_tasks_are_dropped )
+{
+  std::atomic< bool > started( false );
+  std::atomic< bool > blocked( true );
+  std::atomic< int > call_count( 0 );
+
+  const wfl::mt::shared_function< void() > blocker
+    ( [ &started, &blocked ]() -> void
+      {
+        started.store( true );
+
+        while ( blocked.load() )
+          std::this_thread::yield();
+      } );
+
+  wfl::mt::thread_pool pool( 1 );
+  pool.submit( blocker );
+
+  // The worker must be busy before the other tasks are submitted,
+  // otherwise it could run them before the blocker.
+  while ( !started.load() )
+    std::this_thread::yield();
+
+  {
+    const wfl::mt::shared_function< void() > shared
+      ( [ &call_count ]() -> void
+        {
+          ++call_count;
+        } );
+
+    for ( int i( 0 ); i != 100; ++i )
+      pool.submit( shared );
+  }
+
+  blocked.store( false );
+
+  while ( pool.run_count() + pool.dropped_count() != 101 )
+    std::this_thread::yield();
+
+  EXPECT_EQ( 0, call_count.load() );
+  EXPECT_EQ( 1u, pool.run_count() );
+  EXPECT_EQ( 100u, pool.dropped_count() );
+}
+
+TEST( wfl_thread_pool, idle_workers_steal_tasks )
+{
+  constexpr int worker_count( 4 );
+
+  wfl::mt::thread_pool pool( worker_count );
+  std::atomic< int > stolen_count( 0 );
+
+  const wfl::mt::shared_function< void() > stolen
+    ( [ &stolen_count ]() -> void
+      {
+        ++stolen_count;
+      } );
+
+  std::atomic< bool > done( false );
+
+  // The tasks submitted by a worker go in its own queue, thus they can
+  // only run while it is busy if another worker steals them.
+  const wfl::mt::shared_function< void() > submitter
+    ( [ & ]() -> void
+      {
+        for ( int i( 0 ); i != worker_count - 1; ++i )
+          pool.submit( stolen );
+
+        const std::chrono::steady_clock::time_point deadline
+          ( std::chrono::steady_clock::now() + std::chrono::seconds( 10 ) );
+
+        while ( ( stolen_count.load() != worker_count - 1 )
+                && ( std::chrono::steady_clock::now() < deadline ) )
+          std::this_thread::yield();
+
+        done.store( true );
+      } );
+
+  pool.submit( submitter );
+
+  while ( !done.load() )
+    std::this_thread::yield();
+
+  EXPECT_EQ( worker_count - 1, stolen_count.load() );
+}
+
+TEST( wfl_thread_pool, destructor_waits_for_the_tasks )
+{
+  std::atomic< int > call_count( 0 );
+  const wfl::mt::shared_function< void() > shared
+    ( [ &call_count ]() -> void
+      {
+        std::this_thread::sleep_for( std::chrono::microseconds( 10 ) );
+        ++call_count;
+      } );
+
+  {
+    wfl::mt::thread_pool pool( 2 );
+
+    for ( int i( 0 ); i != 100; ++i )
+      pool.submit( shared );
+  }
+
+  EXPECT_EQ( 100, call_count.load() );
+}
@@ -6,7 +6,9 @@
 #include "wfl/shared_function.hpp"
 
 #include <memory>
+#include <string>
 #include <thread>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -316,3 +318,367 @@ TEST( wfl_weak_function, argument )
   weak( value );
   EXPECT_EQ( value, argument_value );
 }
+
+TEST( wfl_weak_function, handle_fits_in_a_word )
+{
+  EXPECT_EQ( sizeof( std::uint64_t ), sizeof( wfl::weak_function< void() > ) );
+  EXPECT_EQ
+    ( sizeof( std::uint64_t ), sizeof( wfl::shared_function< void() > ) );
+}
+
+TEST( wfl_weak_function, expired )
+{
+  EXPECT_TRUE( wfl::weak_function< void() >().expired() );
+
+  wfl::weak_function< void() > weak;
+
+  {
+    const wfl::shared_function< void() > shared
+      ( []() -> void
+        {
+        } );
+    weak = shared;
+
+    EXPECT_FALSE( weak.expired() );
+  }
+
+  EXPECT_TRUE( weak.expired() );
+}
+
+TEST( wfl_weak_function, call_all )
+{
+  std::vector< int > values( 10, 0 );
+  std::vector< std::unique_ptr< wfl::shared_function< void( int ) > > > shared;
+
+  for ( int& v : values )
+    shared.emplace_back
+      ( new wfl::shared_function< void( int ) >
+        ( [ &v ]( int value ) -> void
+          {
+            v += value;
+          } ) );
+
+  std::vector< wfl::weak_function< void( int ) > > weak;
+
+  for ( const auto& f : shared )
+    weak.emplace_back( *f );
+
+  EXPECT_EQ
+    ( 10u,
+      wfl::weak_function< void( int ) >::call_all
+      ( weak.begin(), weak.end(), 2 ) );
+
+  for ( int v : values )
+    EXPECT_EQ( 2, v );
+
+  for ( std::size_t i( 0 ); i < shared.size(); i += 2 )
+    shared[ i ].reset();
+
+  EXPECT_EQ
+    ( 5u,
+      wfl::weak_function< void( int ) >::call_all
+      ( weak.begin(), weak.end(), 3 ) );
+
+  for ( std::size_t i( 0 ); i != values.size(); ++i )
+    EXPECT_EQ( ( i % 2 == 0 ) ? 2 : 5, values[ i ] );
+}
+
+TEST( wfl_weak_function, call_all_copies_arguments )
+{
+  std::vector< std::string > received;
+  const auto receive
+    ( [ & ]( std::string s ) -> void
+      {
+        received.emplace_back( std::move( s ) );
+      } );
+
+  const wfl::shared_function< void( std::string ) > shared_1( receive );
+  const wfl::shared_function< void( std::string ) > shared_2( receive );
+  const wfl::weak_function< void( std::string ) > weak[] =
+    { shared_1, shared_2 };
+
+  wfl::weak_function< void( std::string ) >::call_all
+    ( std::begin( weak ), std::end( weak ), "abc" );
+
+  ASSERT_EQ( 2u, received.size() );
+  EXPECT_EQ( "abc", received[ 0 ] );
+  EXPECT_EQ( "abc", received[ 1 ] );
+}
+
+TEST( wfl_weak_function, call_all_copies_rvalue_arguments )
+{
+  std::vector< std::string > received;
+  const auto receive
+    ( [ & ]( std::string&& s ) -> void
+      {
+        received.emplace_back( std::move( s ) );
+      } );
+
+  const wfl::shared_function< void( std::string&& ) > shared_1( receive );
+  const wfl::shared_function< void( std::string&& ) > shared_2( receive );
+  const wfl::weak_function< void( std::string&& ) > weak[] =
+    { shared_1, shared_2 };
+
+  wfl::weak_function< void( std::string&& ) >::call_all
+    ( std::begin( weak ), std::end( weak ), std::string( "abc" ) );
+
+  ASSERT_EQ( 2u, received.size() );
+  EXPECT_EQ( "abc", received[ 0 ] );
+  EXPECT_EQ( "abc", received[ 1 ] );
+}
+
+TEST( wfl_weak_function, nested_call_all )
+{
+  int call_count( 0 );
+  std::vector< wfl::weak_function< void() > > inner;
+  const wfl::shared_function< void() > count
+    ( [ & ]() -> void
+      {
+        ++call_count;
+      } );
+
+  inner.emplace_back( count );
+  inner.emplace_back( count );
+
+  const wfl::shared_function< void() > outer
+    ( [ & ]() -> void
+      {
+        wfl::weak_function< void() >::call_all( inner.begin(), inner.end() );
+      } );
+  const wfl::weak_function< void() > weak[] = { outer, outer, count };
+
+  EXPECT_EQ
+    ( 3u,
+      wfl::weak_function< void() >::call_all
+      ( std::begin( weak ), std::end( weak ) ) );
+  EXPECT_EQ( 5, call_count );
+}
+
+TEST( wfl_weak_function, valid_after_move_of_shared )
+{
+  int call_count( 0 );
+  std::unique_ptr< wfl::shared_function< void() > > moved;
+
+  wfl::weak_function< void() > weak;
+
+  {
+    wfl::shared_function< void() > shared
+      ( [ & ]() -> void
+        {
+          ++call_count;
+        } );
+    weak = shared;
+    moved.reset( new wfl::shared_function< void() >( std::move( shared ) ) );
+  }
+
+  weak();
+  EXPECT_EQ( 1, call_count );
+
+  moved.reset();
+  weak();
+  EXPECT_EQ( 1, call_count );
+}
+
+TEST( wfl_weak_function, result )
+{
+  wfl::weak_function< int( int ) > weak;
+
+  {
+    const wfl::shared_function< int( int ) > shared
+      ( []( int value ) -> int
+        {
+          return 2 * value;
+        } );
+    weak = shared;
+
+    const wfl::optional< int > result( weak( 21 ) );
+    ASSERT_TRUE( result.has_value() );
+    EXPECT_EQ( 42, *result );
+  }
+
+  EXPECT_FALSE( weak( 21 ).has_value() );
+  EXPECT_EQ( -1, weak( 21 ).value_or( -1 ) );
+}
+
+TEST( wfl_weak_function, move_only_result )
+{
+  const wfl::shared_function< std::unique_ptr< int >() > shared
+    ( []() -> std::unique_ptr< int >
+      {
+        return std::unique_ptr< int >( new int( 24 ) );
+      } );
+  const wfl::weak_function< std::unique_ptr< int >() > weak( shared );
+
+  wfl::optional< std::unique_ptr< int > > result( weak() );
+  ASSERT_TRUE( result.has_value() );
+  ASSERT_NE( nullptr, result->get() );
+  EXPECT_EQ( 24, **result );
+}
+
+TEST( wfl_weak_function, reference_result )
+{
+  int value( 0 );
+
+  const wfl::shared_function< int&() > shared
+    ( [ & ]() -> int&
+      {
+        return value;
+      } );
+  const wfl::weak_function< int&() > weak( shared );
+
+  const wfl::optional< int& > result( weak() );
+  ASSERT_TRUE( result.has_value() );
+  EXPECT_EQ( &value, &*result );
+}
+
+TEST( wfl_weak_function, expired_after_trim )
+{
+  // The test runs in its own thread such that the storage is empty.
+  std::thread thread
+    ( []() -> void
+      {
+        wfl::detail::function_allocator& allocator
+          ( wfl::detail::thread_local_function_allocator::instance() );
+        allocator.reserve( 100, sizeof( int* ) );
+
+        int call_count( 0 );
+        std::vector< wfl::weak_function< void() > > weak;
+
+        {
+          std::vector< wfl::shared_function< void() > > shared;
+
+          for ( int i( 0 ); i != 100; ++i )
+            {
+              shared.emplace_back
+                ( [ &call_count ]() -> void
+                  {
+                    ++call_count;
+                  } );
+              weak.emplace_back( shared.back() );
+            }
+        }
+
+        EXPECT_NE( 0u, allocator.statistics().page_count );
+
+        allocator.trim();
+
+        // All the blocks are free, thus all the pages are released.
+        EXPECT_EQ( 0u, allocator.statistics().page_count );
+
+        std::vector< wfl::shared_function< void() > > shared;
+
+        for ( int i( 0 ); i != 100; ++i )
+          shared.emplace_back
+            ( [ &call_count ]() -> void
+              {
+                ++call_count;
+              } );
+
+        for ( const wfl::weak_function< void() >& w : weak )
+          {
+            EXPECT_TRUE( w.expired() );
+            w();
+          }
+
+        EXPECT_EQ( 0, call_count );
+
+        for ( const wfl::shared_function< void() >& f : shared )
+          f();
+
+        EXPECT_EQ( 100, call_count );
+      } );
+
+  thread.join();
+}
+
+TEST( wfl_weak_function, statistics )
+{
+  // The test runs in its own thread such that the counters start at zero.
+  std::thread thread
+    ( []() -> void
+      {
+        wfl::detail::function_allocator& allocator
+          ( wfl::detail::thread_local_function_allocator::instance() );
+
+        wfl::weak_function< void() > weak;
+
+        {
+          const wfl::shared_function< void() > shared_1
+            ( []() -> void
+              {
+              } );
+          const wfl::shared_function< void() > shared_2( shared_1 );
+          const wfl::shared_function< void() > shared_3
+            ( []() -> void
+              {
+              } );
+
+          weak = shared_1;
+          weak();
+          weak();
+
+          const wfl::detail::allocator_statistics statistics
+            ( allocator.statistics() );
+
+          EXPECT_EQ( 2u, statistics.live_count );
+          EXPECT_EQ( 2u, statistics.peak_live_count );
+          EXPECT_EQ( 2u, statistics.allocation_count );
+          EXPECT_EQ( 0u, statistics.release_count );
+        }
+
+        weak();
+
+        const wfl::detail::allocator_statistics statistics
+          ( allocator.statistics() );
+
+        EXPECT_EQ( 0u, statistics.live_count );
+        EXPECT_EQ( 2u, statistics.peak_live_count );
+        EXPECT_EQ( 2u, statistics.allocation_count );
+        EXPECT_EQ( 2u, statistics.release_count );
+        EXPECT_EQ( 2u, statistics.call_count );
+        EXPECT_EQ( 1u, statistics.expired_call_count );
+        EXPECT_EQ( 2u, statistics.available_count );
+      } );
+
+  thread.join();
+}
+
+TEST( wfl_weak_function, deferred_destruction )
+{
+  // The test runs in its own thread such that the mode does not leak into
+  // the other tests.
+  std::thread thread
+    ( []() -> void
+      {
+        wfl::detail::function_allocator& allocator
+          ( wfl::detail::thread_local_function_allocator::instance() );
+        allocator.defer_destruction( true );
+
+        std::shared_ptr< int > sentinel( std::make_shared< int >( 0 ) );
+        const std::weak_ptr< int > weak_sentinel( sentinel );
+        wfl::weak_function< int() > weak;
+
+        {
+          const wfl::shared_function< int() > shared
+            ( [ sentinel ]() -> int
+              {
+                return *sentinel;
+              } );
+          weak = shared;
+        }
+
+        sentinel.reset();
+
+        EXPECT_TRUE( weak.expired() );
+        EXPECT_FALSE( weak_sentinel.expired() );
+
+        allocator.collect();
+
+        EXPECT_TRUE( weak_sentinel.expired() );
+        EXPECT_FALSE( weak().has_value() );
+
+        allocator.defer_destruction( false );
+      } );
+
+  thread.join();
+}